@@ -0,0 +1,27 @@
+#ifndef SYSNP_BENCH_H
+#define SYSNP_BENCH_H
+
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include "machine.h"
+
+namespace sysnp {
+
+namespace bench {
+
+std::shared_ptr<Machine> loadMachine(std::string);
+
+// Reports the rate of `cycles` over the time since `start`.
+void report(std::string, uint64_t, std::chrono::time_point<std::chrono::steady_clock>);
+
+int clock(int, char*[]);
+int pipeline(int, char*[]);
+int cache(int, char*[]);
+
+}; // namespace bench
+
+}; // namespace sysnp
+
+#endif
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+#include "bench.h"
+
+namespace sysnp {
+
+namespace bench {
+
+std::shared_ptr<Machine> loadMachine(std::string configFile) {
+    std::ifstream file(configFile, std::ios::in|std::ios::binary|std::ios::ate);
+
+    if (!file.is_open()) {
+        std::cout << "Configuration file not found." << std::endl;
+        return 0;
+    }
+
+    size_t size = file.tellg();
+    file.seekg(0);
+
+    char *fileContent = new char[size];
+    file.read(fileContent, size);
+    file.close();
+
+    ryml::Tree tree = ryml::parse_in_place({fileContent, size});
+
+    std::shared_ptr<Machine> machine = std::make_shared<Machine>();
+    machine->load(tree.rootref());
+
+    delete[] fileContent;
+
+    return machine;
+}
+
+void report(std::string name, uint64_t cycles, std::chrono::time_point<std::chrono::steady_clock> start) {
+    auto diff = std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(24) << name << std::right;
+    std::cout << std::setw(12) << cycles << " cycles ";
+    std::cout << std::setw(14) << diff << " ns ";
+    std::cout << std::setw(12) << std::fixed << std::setprecision(1) << (cycles / ((double) diff / 1000000)) << " kHz ";
+    std::cout << std::setw(8) << std::fixed << std::setprecision(1) << ((double) diff / cycles) << " ns/cycle" << std::endl;
+}
+
+}; // namespace bench
+
+}; // namespace sysnp
+
+int main(int argc, char* argv[]) {
+    std::string benchmark = argc > 1 ? argv[1] : "";
+
+    if (benchmark == "clock") {
+        return sysnp::bench::clock(argc - 1, argv + 1);
+    }
+    if (benchmark == "pipeline") {
+        return sysnp::bench::pipeline(argc - 1, argv + 1);
+    }
+    if (benchmark == "cache") {
+        return sysnp::bench::cache(argc - 1, argv + 1);
+    }
+
+    std::cout << "usage: " << argv[0] << " <benchmark> [options]" << std::endl;
+    std::cout << "  clock [config] [cycles]   bus dispatch, interfaces vs compiled schedule" << std::endl;
+    std::cout << "  pipeline [config] [cycles] CPU cost per cycle, pipelined vs functional" << std::endl;
+    std::cout << "  cache [lookups]           cache lookup cost by associativity" << std::endl;
+    return -1;
+}
@@ -0,0 +1,47 @@
+#include <iostream>
+
+#include "bench.h"
+#include "nbus/cpu/cache.h"
+
+namespace sysnp {
+
+namespace bench {
+
+// Looks addresses up in caches of the same size and growing associativity,
+// half of them hits.
+int cache(int argc, char* argv[]) {
+    uint64_t lookups = argc > 1 ? std::stoull(argv[1], nullptr, 0) : 10000000;
+
+    const int lineBits = 4;
+    const int totalBits = 12;
+    for (int wayBits = 1; wayBits <= 4; wayBits++) {
+        int binBits = totalBits - lineBits - wayBits;
+        nbus::n16r::Cache<uint32_t, uint8_t, uint32_t, uint8_t> cache(binBits, lineBits, wayBits, false, -1, 0);
+
+        std::vector<uint8_t> line(1 << lineBits);
+        for (uint32_t address = 0; address < (1u << totalBits); address += 1 << lineBits) {
+            cache.load(address, 0, 0, line);
+        }
+
+        uint32_t address = 1;
+        uint64_t hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < lookups; i++) {
+            // xorshift over twice the cached range
+            address ^= address << 13;
+            address ^= address >> 17;
+            address ^= address << 5;
+            hits += cache.contains(address & ((2u << totalBits) - 1), 2, 0) != nbus::n16r::CacheContainsNone;
+        }
+        report(std::to_string(1 << wayBits) + "-way", lookups, start);
+        if (hits == 0) {
+            std::cout << "no hits" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+}; // namespace bench
+
+}; // namespace sysnp
@@ -0,0 +1,38 @@
+#include <iostream>
+
+#include "bench.h"
+#include "nbus/nbus.h"
+
+namespace sysnp {
+
+namespace bench {
+
+// Clocks the same machine configuration through the NBusInterface
+// dispatch and through the compiled device schedule.
+int clock(int argc, char* argv[]) {
+    std::string configFile = argc > 1 ? argv[1] : "hardware.yaml";
+    uint64_t cycles = argc > 2 ? std::stoull(argv[2], nullptr, 0) : 1000000;
+
+    for (bool compiled: {false, true}) {
+        auto machine = loadMachine(configFile);
+        if (!machine) {
+            return -1;
+        }
+
+        auto bus = std::static_pointer_cast<nbus::NBus>(machine->getDevice("nbus"));
+        bus->setCompiled(compiled);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < cycles; i++) {
+            bus->clockUp();
+            bus->clockDown();
+        }
+        report(compiled ? "compiled" : "interfaces", cycles, start);
+    }
+
+    return 0;
+}
+
+}; // namespace bench
+
+}; // namespace sysnp
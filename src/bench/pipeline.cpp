@@ -0,0 +1,45 @@
+#include <iostream>
+#include <sstream>
+
+#include "bench.h"
+
+namespace sysnp {
+
+namespace bench {
+
+// Clocks the machine with the CPU running the stage pipeline, then with the
+// same CPU in functional mode for comparison.
+int pipeline(int argc, char* argv[]) {
+    std::string configFile = argc > 1 ? argv[1] : "hardware.yaml";
+    uint64_t cycles = argc > 2 ? std::stoull(argv[2], nullptr, 0) : 1000000;
+
+    for (std::string mode: {"pipelined", "functional"}) {
+        auto machine = loadMachine(configFile);
+        if (!machine) {
+            return -1;
+        }
+
+        auto bus = machine->getDevice("nbus");
+        auto cpu = machine->getDevice("n16r");
+        if (!bus || !cpu) {
+            std::cout << "The configuration needs an nbus and an n16r." << std::endl;
+            return -1;
+        }
+
+        std::stringstream command("mode " + mode);
+        cpu->command(command);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < cycles; i++) {
+            bus->clockUp();
+            bus->clockDown();
+        }
+        report(mode, cycles, start);
+    }
+
+    return 0;
+}
+
+}; // namespace bench
+
+}; // namespace sysnp
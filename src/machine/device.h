@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include "machine.h"
+#include "snapshot.h"
 
 namespace sysnp {
 
@@ -17,6 +18,20 @@ class Device {
         virtual void clockUp  () =0;
         virtual void clockDown() =0;
 
+        // Number of cycles until this device next needs to be clocked.
+        // Devices that can't tell return 0 and are clocked every cycle.
+        virtual uint64_t nextEvent() { return 0; }
+        // Advance the device over cycles it reported as idle.
+        virtual void skipCycles(uint64_t) {}
+
+        // Write and restore the device's run-time state. Snapshots are
+        // restored into a machine loaded from the same configuration.
+        virtual void saveState(SnapshotWriter&) {}
+        virtual void loadState(SnapshotReader&) {}
+        // Write the parts of the configuration the layout of the state
+        // depends on, checked before any device's state is restored.
+        virtual void saveGeometry(SnapshotWriter&) {}
+
         virtual std::string command(std::stringstream&) =0;
 
         void setMachine(std::shared_ptr<Machine> machine) {
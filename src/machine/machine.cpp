@@ -101,10 +101,85 @@ bool Machine::readFile(std::string fileName, uint8_t *dest, uint32_t limit) {
     return true;
 }
 
-void Machine::debug(std::string message) {
+// A snapshot is a header, each device's geometry and then each device's
+// state, in device name order, each tagged with the device name.
+void Machine::saveSnapshot(const std::string &fileName) {
+    SnapshotWriter snapshot(fileName);
+    snapshot.writeBytes("sysNPsnp", 8);
+    snapshot.write(snapshotVersion);
+
+    snapshot.write<uint64_t>(devices.size());
+    for (auto &[name, device]: devices) {
+        snapshot.write(name);
+        snapshot.write(deviceGeometry(*device));
+    }
+    saveDevices(snapshot);
+    snapshot.commit();
+}
+// The header and geometry are checked before anything is restored. Should a
+// device's state still fail to load, the machine's own, kept in memory, is
+// put back.
+void Machine::loadSnapshot(const std::string &fileName) {
+    SnapshotReader snapshot(fileName);
+    char magic[8];
+    snapshot.readBytes(magic, sizeof(magic));
+    if (std::string(magic, sizeof(magic)) != "sysNPsnp") {
+        throw std::runtime_error("\"" + fileName + "\" is not a snapshot");
+    }
+    snapshot.expect(snapshotVersion, "snapshot version");
+
+    snapshot.expect<uint64_t>(devices.size(), "device count");
+    for (auto &[name, device]: devices) {
+        std::string snapshotName;
+        snapshot.read(snapshotName);
+        if (snapshotName != name) {
+            throw std::runtime_error("Snapshot has device \"" + snapshotName + "\" where \"" + name + "\" is configured");
+        }
+        std::vector<uint8_t> geometry;
+        snapshot.read(geometry);
+        if (geometry != deviceGeometry(*device)) {
+            throw std::runtime_error("Snapshot doesn't match the configured " + name);
+        }
+    }
+
+    SnapshotWriter undo;
+    saveDevices(undo);
+    try {
+        loadDevices(snapshot);
+    }
+    catch (...) {
+        SnapshotReader restore(undo.getBytes());
+        loadDevices(restore);
+        throw;
+    }
+}
+
+std::vector<uint8_t> Machine::deviceGeometry(Device &device) {
+    SnapshotWriter geometry;
+    device.saveGeometry(geometry);
+    return geometry.getBytes();
+}
+void Machine::saveDevices(SnapshotWriter &snapshot) {
+    for (auto &[name, device]: devices) {
+        snapshot.write(name);
+        device->saveState(snapshot);
+    }
+}
+void Machine::loadDevices(SnapshotReader &snapshot) {
+    for (auto &[name, device]: devices) {
+        std::string snapshotName;
+        snapshot.read(snapshotName);
+        if (snapshotName != name) {
+            throw std::runtime_error("Snapshot has device \"" + snapshotName + "\" where \"" + name + "\" is configured");
+        }
+        device->loadState(snapshot);
+    }
+}
+
+void Machine::debug(const std::string &message) {
     debug(3, message);
 }
-void Machine::debug(int level, std::string message) {
+void Machine::debug(int level, const std::string &message) {
     if (debugLevel >= level) {
         std::cout << "DEBUG[" << level << "]: " << message << std::endl;
     }
@@ -137,29 +212,8 @@ void Machine::run() {
             stopRunning();
         }
         else if (command == "b" || command == "bp") {
-            commandWord = "";
-            cs >> commandWord;
-
             std::shared_ptr<nbus::n16r::N16R> cpu = std::static_pointer_cast<nbus::n16r::N16R>(getDevice("n16r"));
-            if (commandWord == "a" || commandWord == "d") {
-                std::string locationStr;
-                cs >> locationStr;
-                uint32_t location;
-                try {
-                    location = std::stoul(locationStr, nullptr, 0);
-
-                    if (commandWord == "a") {
-                        cpu->breakpointAdd(location);
-                    }
-                    else {
-                        cpu->breakpointRemove(location);
-                    }
-                }
-                catch (std::invalid_argument e) {}
-            }
-            else if (commandWord == "c") {
-                cpu->breakpointClear();
-            }
+            std::cout << cpu->breakpointCommand(cs);
         }
         else if (runMode == RunMode::SteppingMode) {
             if (command == "pulse") {
@@ -215,6 +269,28 @@ void Machine::run() {
                     }
                 }
             }
+            else if (command == "snapshot") {
+                std::string fileName;
+                commandWord = "";
+                cs >> commandWord >> fileName;
+                if ((commandWord != "save" && commandWord != "load") || fileName.empty()) {
+                    std::cout << "Usage: snapshot save|load <file>" << std::endl;
+                }
+                else {
+                    try {
+                        if (commandWord == "save") {
+                            saveSnapshot(fileName);
+                        }
+                        else {
+                            loadSnapshot(fileName);
+                        }
+                        std::cout << "Ok." << std::endl;
+                    }
+                    catch (std::exception &e) {
+                        std::cout << e.what() << std::endl;
+                    }
+                }
+            }
             else if (command == "config") {
                 cs >> commandWord;
                 if (commandWord == "debug") {
@@ -274,25 +350,11 @@ void Machine::run() {
 }
 
 void Machine::startRunning(int maxCycles) {
-    std::shared_ptr<nbus::NBus> bus = std::static_pointer_cast<nbus::NBus>(getDevice("nbus"));
-    std::shared_ptr<nbus::n16r::N16R> cpu = std::static_pointer_cast<nbus::n16r::N16R>(getDevice("n16r"));
+    uint64_t skippedCycles = 0;
 
     runCycles = 0;
     runStart = std::chrono::steady_clock::now();
-    while (clockRunning) {
-        bus->clockUp();
-        bus->clockDown();
-
-        runCycles++;
-
-        if (cpu->breakpointHit()) {
-            clockRunning = false;
-        }
-
-        if (maxCycles > 0 && runCycles >= maxCycles) {
-            clockRunning = false;
-        }
-    }
+    runUntil(maxCycles > 0 ? maxCycles : 0, false, runCycles, skippedCycles);
     runEnd = std::chrono::steady_clock::now();
 
     auto diff = std::chrono::nanoseconds(runEnd - runStart).count();
@@ -302,12 +364,131 @@ void Machine::startRunning(int maxCycles) {
     }
 
     std::cout << "ticks: " << runCycles << std::endl;
+    std::cout << "idle:  " << skippedCycles << std::endl;
     std::cout << "ns:    " << diff << std::endl;
     std::cout << "       " << (runCycles / ((double) diff / 1000000)) << "kHz" << std::endl;
     
     runCycles = 0;
     runMode = RunMode::SteppingMode;
 }
+
+// Clocks the machine until clockRunning is cleared, a breakpoint is hit, the
+// cycle limit (if any) is reached or, optionally, the CPU halts.
+StopReason Machine::runUntil(uint64_t maxCycles, bool stopOnHalt, uint64_t &cycles, uint64_t &skippedCycles) {
+    std::shared_ptr<nbus::NBus> bus = std::static_pointer_cast<nbus::NBus>(getDevice("nbus"));
+    std::shared_ptr<nbus::n16r::N16R> cpu = std::static_pointer_cast<nbus::n16r::N16R>(getDevice("n16r"));
+
+    StopReason reason = StopReason::StopRequested;
+    while (clockRunning) {
+        if (maxCycles > 0 && cycles >= maxCycles) {
+            reason = StopReason::StopCycleLimit;
+            break;
+        }
+        // a halt only counts once outstanding memory traffic has drained
+        if (stopOnHalt && cpu->isHalted() && cpu->isMemoryIdle()) {
+            reason = StopReason::StopHalted;
+            break;
+        }
+
+        // fast-forward over cycles in which no device has anything to do
+        uint64_t idleCycles = bus->nextEvent();
+        if (idleCycles > maxSkipCycles) {
+            idleCycles = maxSkipCycles;
+        }
+        if (maxCycles > 0 && idleCycles > maxCycles - cycles) {
+            idleCycles = maxCycles - cycles;
+        }
+
+        if (idleCycles > 0) {
+            bus->skipCycles(idleCycles);
+            cycles += idleCycles;
+            skippedCycles += idleCycles;
+        }
+        else {
+            bus->clockUp();
+            bus->clockDown();
+
+            cycles++;
+
+            if (cpu->breakpointHit()) {
+                reason = StopReason::StopBreakpoint;
+                break;
+            }
+        }
+    }
+    clockRunning = false;
+
+    return reason;
+}
+
+int Machine::runBatch(const BatchOptions &options) {
+    std::shared_ptr<nbus::n16r::N16R> cpu = std::static_pointer_cast<nbus::n16r::N16R>(getDevice("n16r"));
+    if (!cpu || !getDevice("nbus")) {
+        std::cerr << "Batch runs need an nbus and an n16r." << std::endl;
+        return 1;
+    }
+
+    if (!options.serialInput.empty() || !options.serialOutput.empty()) {
+        auto serial = std::dynamic_pointer_cast<nbus::Serial>(getDevice("serial"));
+        if (!serial) {
+            std::cerr << "No serial device to attach files to." << std::endl;
+            return 1;
+        }
+        try {
+            serial->attachFiles(options.serialInput, options.serialOutput);
+        }
+        catch (std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    for (auto address: options.breakpoints) {
+        cpu->breakpointAdd(address);
+    }
+
+    uint64_t cycles = 0;
+    uint64_t skippedCycles = 0;
+
+    clockRunning = true;
+    runStart = std::chrono::steady_clock::now();
+    StopReason reason = runUntil(options.maxCycles, options.stopOnHalt, cycles, skippedCycles);
+    runEnd = std::chrono::steady_clock::now();
+
+    auto diff = std::chrono::nanoseconds(runEnd - runStart).count();
+
+    const char *reasonName = "requested";
+    switch (reason) {
+        case StopReason::StopCycleLimit: reasonName = "cycles";     break;
+        case StopReason::StopBreakpoint: reasonName = "breakpoint"; break;
+        case StopReason::StopHalted:     reasonName = "halt";       break;
+        default: break;
+    }
+
+    std::stringstream stats;
+    stats << "{\"stop\": \"" << reasonName << "\""
+          << ", \"lastRetired\": \"0x" << std::setw(8) << std::setfill('0') << std::hex << cpu->getRetiredAddress() << std::dec << "\""
+          << ", \"cycles\": " << cycles
+          << ", \"idleCycles\": " << skippedCycles
+          << ", \"retired\": " << cpu->getRetiredCount()
+          << ", \"ns\": " << diff
+          << ", \"kHz\": " << (diff > 0 ? cycles / ((double) diff / 1000000) : 0.0)
+          << "}" << std::endl;
+
+    if (options.statsFile.empty()) {
+        std::cout << stats.str();
+    }
+    else {
+        std::ofstream statsOut(options.statsFile);
+        statsOut << stats.str();
+        if (!statsOut) {
+            std::cerr << "Couldn't write stats to \"" << options.statsFile << "\"" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
 void Machine::stopRunning() {
     clockRunning = false;
     if (runThread.joinable()) {
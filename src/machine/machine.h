@@ -4,6 +4,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
 
 #include <mutex>
 #include <thread>
@@ -13,8 +14,23 @@
 #include <c4/std/string.hpp>
 
 
+#include "snapshot.h"
 #include "device.h"
 
+// Debug messages above this level are compiled out entirely.
+#ifndef SYSNP_DEBUG_MAX_LEVEL
+#define SYSNP_DEBUG_MAX_LEVEL 9
+#endif
+
+// Checks the level before the message expression is evaluated, so that
+// hot paths don't build strings nobody will see.
+#define SYSNP_DEBUG(machine, level, message) \
+    do { \
+        if ((level) <= SYSNP_DEBUG_MAX_LEVEL && (machine)->isDebugEnabled(level)) { \
+            (machine)->debug((level), (message)); \
+        } \
+    } while (0)
+
 namespace sysnp {
 
 class Device;
@@ -24,6 +40,23 @@ enum RunMode {
     FreeRunMode
 };
 
+enum StopReason {
+    StopRequested,
+    StopCycleLimit,
+    StopBreakpoint,
+    StopHalted
+};
+
+// Settings for a headless run; a cycle limit of 0 means no limit.
+struct BatchOptions {
+    uint64_t maxCycles = 0;
+    bool stopOnHalt = false;
+    std::vector<uint32_t> breakpoints;
+    std::string serialInput;
+    std::string serialOutput;
+    std::string statsFile;
+};
+
 class Machine : public std::enable_shared_from_this<Machine> {
   public:
 	Machine() { debugLevel = 0; }
@@ -36,9 +69,14 @@ class Machine : public std::enable_shared_from_this<Machine> {
     bool readFile(std::string,uint8_t*,uint32_t);
 
 	void run();
+    int runBatch(const BatchOptions&);
+
+    void saveSnapshot(const std::string&);
+    void loadSnapshot(const std::string&);
 
-    void debug(int, std::string);
-    void debug(std::string);
+    void debug(int, const std::string&);
+    void debug(const std::string&);
+    bool isDebugEnabled(int level) const { return debugLevel >= level; }
 
   private:
     std::map<std::string,std::shared_ptr<Device>> devices;
@@ -53,11 +91,23 @@ class Machine : public std::enable_shared_from_this<Machine> {
     std::thread runThread;
     std::mutex  runThreadMutex;
 
+    // upper bound on cycles fast-forwarded in one step, so the loop
+    // still gets to check for asynchronous device input
+    const static uint64_t maxSkipCycles = 1 << 16;
+
     void startRunning(int);
     void stopRunning();
 
+    StopReason runUntil(uint64_t, bool, uint64_t&, uint64_t&);
+
+    std::vector<uint8_t> deviceGeometry(Device&);
+    void saveDevices(SnapshotWriter&);
+    void loadDevices(SnapshotReader&);
+
     std::shared_ptr<Device> createDevice(std::string);
 
+    constexpr static uint32_t snapshotVersion = 14;
+
     friend void machineRun(Machine&, int);
 };
 
@@ -0,0 +1,218 @@
+#include "breakpointUnit.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace sysnp {
+
+namespace nbus {
+
+namespace n16r {
+
+bool Breakpoint::matches(const uint16_t *registers) const {
+    uint16_t current = registers[reg];
+    switch (compare) {
+        case BreakEQ: return current == value;
+        case BreakNE: return current != value;
+        case BreakLT: return current <  value;
+        case BreakLE: return current <= value;
+        case BreakGT: return current >  value;
+        case BreakGE: return current >= value;
+        default:      return true;
+    }
+}
+
+BreakpointUnit::BreakpointUnit() {
+    rebuildFilters();
+}
+
+void BreakpointUnit::clear() {
+    breakpoints.clear();
+    watchpoints.clear();
+    rebuildFilters();
+}
+
+void BreakpointUnit::add(const Breakpoint &breakpoint) {
+    auto location = std::lower_bound(breakpoints.begin(), breakpoints.end(), breakpoint.address,
+            [](const Breakpoint &b, uint32_t address) { return b.address < address; });
+    if (location != breakpoints.end() && location->address == breakpoint.address) {
+        *location = breakpoint;
+    }
+    else {
+        breakpoints.insert(location, breakpoint);
+    }
+    mark(breakFilter, breakpoint.address, 1);
+}
+bool BreakpointUnit::remove(uint32_t address) {
+    auto location = find(address);
+    if (location == breakpoints.end()) {
+        return false;
+    }
+    breakpoints.erase(location);
+    rebuildFilters();
+    return true;
+}
+
+void BreakpointUnit::addWatch(const Watchpoint &watchpoint) {
+    removeWatch(watchpoint.start);
+    watchpoints.push_back(watchpoint);
+    mark(watchFilter, watchpoint.start, watchpoint.size);
+}
+bool BreakpointUnit::removeWatch(uint32_t start) {
+    auto location = std::find_if(watchpoints.begin(), watchpoints.end(),
+            [start](const Watchpoint &w) { return w.start == start; });
+    if (location == watchpoints.end()) {
+        return false;
+    }
+    watchpoints.erase(location);
+    rebuildFilters();
+    return true;
+}
+
+void BreakpointUnit::mark(PageFilter &filter, uint32_t start, uint32_t size) {
+    uint64_t firstPage = start >> pageBits;
+    uint64_t lastPage = ((uint64_t) start + std::max<uint32_t>(size, 1) - 1) >> pageBits;
+    // a range this long sets every bit anyway
+    if (lastPage - firstPage >= (1 << filterBits)) {
+        filter.fill(~0ull);
+        return;
+    }
+    for (uint64_t page = firstPage; page <= lastPage; page++) {
+        uint32_t index = filterIndex(page << pageBits);
+        filter[index >> 6] |= 1ull << (index & 63);
+    }
+}
+void BreakpointUnit::rebuildFilters() {
+    breakFilter.fill(0);
+    watchFilter.fill(0);
+    for (auto &breakpoint: breakpoints) {
+        mark(breakFilter, breakpoint.address, 1);
+    }
+    for (auto &watchpoint: watchpoints) {
+        mark(watchFilter, watchpoint.start, watchpoint.size);
+    }
+}
+
+std::vector<Breakpoint>::const_iterator BreakpointUnit::find(uint32_t address) const {
+    auto location = std::lower_bound(breakpoints.begin(), breakpoints.end(), address,
+            [](const Breakpoint &b, uint32_t address) { return b.address < address; });
+    if (location != breakpoints.end() && location->address != address) {
+        return breakpoints.end();
+    }
+    return location;
+}
+bool BreakpointUnit::checkBreakpoint(uint32_t address, const uint16_t *registers) const {
+    auto location = find(address);
+    return location != breakpoints.end() && location->matches(registers);
+}
+bool BreakpointUnit::checkWatchpoints(uint32_t address, uint8_t bytes, WatchAccess access) const {
+    for (auto &watchpoint: watchpoints) {
+        if (!(watchpoint.access & access)) {
+            continue;
+        }
+        // overlap, with the sums done in 64 bits so ranges may end at 4GB
+        if ((uint64_t) address < (uint64_t) watchpoint.start + watchpoint.size &&
+            (uint64_t) address + bytes > watchpoint.start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *compareNames[] = {"", "==", "!=", "<", "<=", ">", ">="};
+
+std::string BreakpointUnit::command(std::stringstream &input) {
+    std::stringstream response;
+
+    std::string commandWord = "l";
+    input >> commandWord;
+
+    try {
+        if (commandWord == "a") {
+            std::string address, condition, reg, compare, value;
+            input >> address >> condition >> reg >> compare >> value;
+
+            Breakpoint breakpoint;
+            breakpoint.address = std::stoul(address, nullptr, 0);
+            if (condition == "if") {
+                // registers are numbered in octal, as dev n16r status shows them
+                auto index = std::stoul(reg, nullptr, 8);
+                auto name = std::find(std::begin(compareNames) + 1, std::end(compareNames), compare);
+                if (index >= 48 || name == std::end(compareNames)) {
+                    throw std::invalid_argument(condition);
+                }
+                breakpoint.reg = index;
+                breakpoint.compare = (BreakCompare) (name - std::begin(compareNames));
+                breakpoint.value = std::stoul(value, nullptr, 0);
+            }
+            else if (!condition.empty()) {
+                throw std::invalid_argument(condition);
+            }
+            add(breakpoint);
+        }
+        else if (commandWord == "d") {
+            std::string address;
+            input >> address;
+            remove(std::stoul(address, nullptr, 0));
+        }
+        else if (commandWord == "w") {
+            std::string address, size = "1", access = "rw";
+            input >> address >> size >> access;
+
+            Watchpoint watchpoint;
+            watchpoint.start = std::stoul(address, nullptr, 0);
+            watchpoint.size = std::stoul(size, nullptr, 0);
+            if (access == "r") {
+                watchpoint.access = WatchRead;
+            }
+            else if (access == "w") {
+                watchpoint.access = WatchWrite;
+            }
+            else if (access != "rw" || watchpoint.size == 0) {
+                throw std::invalid_argument(access);
+            }
+            addWatch(watchpoint);
+        }
+        else if (commandWord == "wd") {
+            std::string address;
+            input >> address;
+            removeWatch(std::stoul(address, nullptr, 0));
+        }
+        else if (commandWord == "c") {
+            clear();
+        }
+        else if (commandWord == "l") {
+            for (auto &breakpoint: breakpoints) {
+                response << "break " << std::setw(8) << std::setfill('0') << std::hex << breakpoint.address;
+                if (breakpoint.compare != BreakAlways) {
+                    response << " if " << std::oct << (int) breakpoint.reg << " " << compareNames[breakpoint.compare];
+                    response << " " << std::hex << breakpoint.value;
+                }
+                response << std::endl;
+            }
+            for (auto &watchpoint: watchpoints) {
+                response << "watch " << std::setw(8) << std::setfill('0') << std::hex << watchpoint.start;
+                response << " " << std::dec << watchpoint.size << " ";
+                response << (watchpoint.access == WatchRead ? "r" : watchpoint.access == WatchWrite ? "w" : "rw");
+                response << std::endl;
+            }
+        }
+        else {
+            throw std::invalid_argument(commandWord);
+        }
+    }
+    catch (std::logic_error &e) {
+        response << "Usage: bp a <addr> [if <reg> ==|!=|<|<=|>|>= <value>]" << std::endl;
+        response << "       bp d <addr>" << std::endl;
+        response << "       bp w <addr> [<bytes> [r|w|rw]]" << std::endl;
+        response << "       bp wd <addr>" << std::endl;
+        response << "       bp l|c" << std::endl;
+    }
+
+    return response.str();
+}
+
+}; // namespace n16r
+
+}; // namespace nbus
+
+}; // namespace sysnp
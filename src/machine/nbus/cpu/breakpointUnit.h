@@ -0,0 +1,118 @@
+#ifndef SYSNP_BREAKPOINTUNIT_H
+#define SYSNP_BREAKPOINTUNIT_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <sstream>
+
+namespace sysnp {
+
+namespace nbus {
+
+namespace n16r {
+
+enum BreakCompare : uint8_t {
+    BreakAlways,
+    BreakEQ,
+    BreakNE,
+    BreakLT,
+    BreakLE,
+    BreakGT,
+    BreakGE
+};
+
+// An instruction breakpoint, optionally only taken when a register compares
+// true against a value.
+struct Breakpoint {
+    uint32_t address = 0;
+    BreakCompare compare = BreakAlways;
+    uint8_t reg = 0;
+    uint16_t value = 0;
+
+    bool matches(const uint16_t*) const;
+};
+
+enum WatchAccess : uint8_t {
+    WatchRead      = 1,
+    WatchWrite     = 2,
+    WatchReadWrite = 3
+};
+
+struct Watchpoint {
+    uint32_t start = 0;
+    uint32_t size = 1;
+    WatchAccess access = WatchReadWrite;
+};
+
+// Instruction breakpoints and data watchpoints. Each kind sits behind a
+// hashed page filter, so an address on a page without any costs a bit test.
+class BreakpointUnit {
+    public:
+        BreakpointUnit();
+
+        void clear();
+        void add(const Breakpoint&);
+        bool remove(uint32_t);
+        void addWatch(const Watchpoint&);
+        bool removeWatch(uint32_t);
+
+        bool hasWatchpoints() const { return !watchpoints.empty(); }
+
+        // any breakpoint at the address, whatever its condition
+        bool contains(uint32_t address) const {
+            return mayHit(breakFilter, address) && find(address) != breakpoints.end();
+        }
+        // a breakpoint at the address that tests a register
+        bool isConditional(uint32_t address) const {
+            if (!mayHit(breakFilter, address)) {
+                return false;
+            }
+            auto location = find(address);
+            return location != breakpoints.end() && location->compare != BreakAlways;
+        }
+        bool isHit(uint32_t address, const uint16_t *registers) const {
+            return mayHit(breakFilter, address) && checkBreakpoint(address, registers);
+        }
+        bool isWatched(uint32_t address, uint8_t bytes, WatchAccess access) const {
+            return (mayHit(watchFilter, address) || mayHit(watchFilter, address + bytes - 1)) &&
+                   checkWatchpoints(address, bytes, access);
+        }
+
+        std::string command(std::stringstream&);
+
+    private:
+        const static int pageBits = 12;
+        const static int filterBits = 12;
+        using PageFilter = std::array<uint64_t, (1 << filterBits) / 64>;
+
+        PageFilter breakFilter;
+        PageFilter watchFilter;
+        // sorted by address
+        std::vector<Breakpoint> breakpoints;
+        std::vector<Watchpoint> watchpoints;
+
+        static uint32_t filterIndex(uint32_t address) {
+            uint32_t page = address >> pageBits;
+            return (page ^ (page >> filterBits)) & ((1 << filterBits) - 1);
+        }
+        static bool mayHit(const PageFilter &filter, uint32_t address) {
+            uint32_t index = filterIndex(address);
+            return (filter[index >> 6] >> (index & 63)) & 1;
+        }
+        static void mark(PageFilter&, uint32_t, uint32_t);
+        void rebuildFilters();
+
+        std::vector<Breakpoint>::const_iterator find(uint32_t) const;
+        bool checkBreakpoint(uint32_t, const uint16_t*) const;
+        bool checkWatchpoints(uint32_t, uint8_t, WatchAccess) const;
+};
+
+}; // namespace n16r
+
+}; // namespace nbus
+
+}; // namespace sysnp
+
+#endif
@@ -1,5 +1,6 @@
 #include "busunit.h"
 #include <iostream>
+#include <algorithm>
 
 namespace sysnp {
 
@@ -9,6 +10,7 @@ namespace n16r {
 
 void BusUnit::setBusInterface(std::shared_ptr<NBusInterface> interface) {
     this->interface = interface;
+    transactionMode = interface->isTransactionMode();
 }
 void BusUnit::reset() {
     phase = BusPhase::BusIdle;
@@ -19,6 +21,42 @@ void BusUnit::reset() {
     interruptState = 0;
     addressCounter = 0;
     dataCounter = 0;
+    transactionDelay = 0;
+}
+
+void BusUnit::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(phase);
+    snapshot.write(notReady);
+    snapshot.write(addressCounter);
+    snapshot.write(dataCounter);
+    snapshot.write(readMode);
+    snapshot.write(writeMode);
+    snapshot.write(interruptState);
+    snapshot.write(transactionDelay);
+
+    snapshot.write(currentOperation.address);
+    snapshot.write(currentOperation.isRead);
+    snapshot.write(currentOperation.data);
+    snapshot.write(currentOperation.bytes);
+    snapshot.write(currentOperation.isValid);
+    snapshot.write(currentOperation.wrapBytes);
+}
+void BusUnit::loadState(SnapshotReader &snapshot) {
+    snapshot.read(phase);
+    snapshot.read(notReady);
+    snapshot.read(addressCounter);
+    snapshot.read(dataCounter);
+    snapshot.read(readMode);
+    snapshot.read(writeMode);
+    snapshot.read(interruptState);
+    snapshot.read(transactionDelay);
+
+    snapshot.read(currentOperation.address);
+    snapshot.read(currentOperation.isRead);
+    snapshot.read(currentOperation.data);
+    snapshot.read(currentOperation.bytes);
+    snapshot.read(currentOperation.isValid);
+    snapshot.read(currentOperation.wrapBytes);
 }
 
 void BusUnit::clockUp() {
@@ -30,7 +68,7 @@ void BusUnit::clockUp() {
     switch (phase) {
         case BusPhase::BusBegin:
         case BusPhase::BusWait:
-            interface->assertSignal(NBusSignal::Address, (currentOperation.address + addressCounter) & 0xfffffe);
+            interface->assertSignal(NBusSignal::Address, getAddress());
             interface->assertSignal(NBusSignal::ReadEnable, readMode);
             interface->assertSignal(NBusSignal::WriteEnable, writeMode);
             if (!currentOperation.isRead) {
@@ -41,7 +79,7 @@ void BusUnit::clockUp() {
             if (!currentOperation.isRead) {
                 interface->assertSignal(NBusSignal::Data, currentOperation.data[dataCounter]);
             }
-            interface->assertSignal(NBusSignal::Address, (currentOperation.address + addressCounter) & 0xfffffe);
+            interface->assertSignal(NBusSignal::Address, getAddress());
             interface->assertSignal(NBusSignal::ReadEnable, readMode);
             interface->assertSignal(NBusSignal::WriteEnable, writeMode);
             break;
@@ -73,6 +111,14 @@ void BusUnit::clockDown() {
     interruptState = interrupts;
 
     notReady = interface->senseSignal(NBusSignal::NotReady) > 0;
+
+    if (transactionMode) {
+        if (transactionDelay > 0) {
+            transactionDelay--;
+        }
+        return;
+    }
+
     uint16_t data = (uint16_t) (interface->senseSignal(NBusSignal::Data) & 0xffff);
 
     switch (phase) {
@@ -123,27 +169,39 @@ void BusUnit::clockDown() {
                 phase = BusPhase::BusBegin;
                 addressCounter = 0;
                 dataCounter = -1;
-                readMode = currentOperation.bytes > 2 ? 0b10 : 0b01;
-                if (currentOperation.isRead) {
-                    writeMode = 0b00;
-                }
-                else if (currentOperation.bytes == 1) {
-                    writeMode = (currentOperation.address & 1) ? 0b10 : 0b01;
-                }
-                else {
-                    writeMode = 0b11;
-                }
+                readMode = currentOperation.bytes > 2 ? NBusReadBurst : NBusReadWord;
+                writeMode = getWriteMode(currentOperation);
             }
             break;
     }
 }
 
 bool BusUnit::isIdle() {
-    return phase == BusPhase::BusIdle && !notReady;
+    return phase == BusPhase::BusIdle && !notReady && transactionDelay <= 0;
+}
+
+uint64_t BusUnit::quietCycles() {
+    if (!transactionMode || transactionDelay <= 0) {
+        return 0;
+    }
+    // words read critical word first come over one by one as the delay runs out
+    int handOver = currentOperation.isRead && currentOperation.wrapBytes ? currentOperation.data.size() : 1;
+    return std::max(transactionDelay - handOver, 0);
+}
+void BusUnit::skipCycles(uint64_t cycles) {
+    transactionDelay -= std::min<uint64_t>(cycles, std::max(transactionDelay, 0));
 }
 
 bool BusUnit::hasData() {
-    return currentOperation.isRead && currentOperation.isValid && currentOperation.data.size() > 0;
+    if (!currentOperation.isRead || !currentOperation.isValid || currentOperation.data.size() <= 0) {
+        return false;
+    }
+    // a line read critical word first hands each word over when it would
+    // have arrived, not only once the whole transaction is done
+    if (currentOperation.wrapBytes) {
+        return currentOperation.data.size() > transactionDelay;
+    }
+    return transactionDelay <= 0;
 }
 
 uint16_t BusUnit::getWord() {
@@ -161,6 +219,70 @@ uint16_t BusUnit::getWord() {
 
 void BusUnit::queueOperation(BusOperation operation) {
     currentOperation = operation;
+
+    if (transactionMode && currentOperation.isValid && currentOperation.bytes > 0) {
+        startTransaction();
+    }
+}
+
+void BusUnit::startTransaction() {
+    NBusTransaction transaction;
+    transaction.address = currentOperation.address;
+
+    // the device reads the block in order; the words are turned round
+    // afterwards to come back critical word first
+    int wrapOffset = 0;
+    if (currentOperation.isRead && currentOperation.wrapBytes) {
+        wrapOffset = currentOperation.address & (currentOperation.wrapBytes - 1);
+        transaction.address -= wrapOffset;
+    }
+    transaction.writeEnable = getWriteMode(currentOperation);
+
+    if (currentOperation.isRead) {
+        transaction.words = (currentOperation.bytes + 1) / 2;
+    }
+    else {
+        transaction.words = currentOperation.data.size();
+        transaction.data = currentOperation.data;
+    }
+
+    // the device does the whole transfer now; we just hold the result
+    // back for as long as it would have taken
+    transactionDelay = interface->transact(transaction);
+
+    if (currentOperation.isRead) {
+        currentOperation.data = transaction.data;
+        std::rotate(currentOperation.data.begin(), currentOperation.data.begin() + wrapOffset / 2, currentOperation.data.end());
+    }
+    currentOperation.bytes = 0;
+}
+
+void BusUnit::writeThrough(const BusOperation &operation) {
+    NBusTransaction transaction;
+    transaction.address = operation.address;
+    transaction.writeEnable = getWriteMode(operation);
+    transaction.words = operation.data.size();
+    transaction.data = operation.data;
+    interface->transact(transaction);
+}
+
+int BusUnit::getWriteMode(const BusOperation &operation) {
+    if (operation.isRead) {
+        return 0b00;
+    }
+    else if (operation.bytes == 1) {
+        return (operation.address & 1) ? 0b10 : 0b01;
+    }
+    return 0b11;
+}
+
+uint32_t BusUnit::getAddress() {
+    uint32_t address = currentOperation.address + addressCounter;
+    if (currentOperation.wrapBytes) {
+        uint32_t mask = currentOperation.wrapBytes - 1;
+        address = (currentOperation.address & ~mask) | (address & mask);
+    }
+    return address & 0xfffffe;
 }
 
 uint8_t BusUnit::hasInterrupt() {
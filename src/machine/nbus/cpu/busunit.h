@@ -15,6 +15,9 @@ struct BusOperation {
     std::vector<uint16_t> data;
     int bytes = 0;
     bool isValid = true;
+    // reads of a line starting from its critical word: the size of the
+    // aligned block the address wraps round in, or 0 to read straight on
+    int wrapBytes = 0;
 };
 
 class BusUnit {
@@ -26,11 +29,21 @@ class BusUnit {
 
         bool isIdle();
         void queueOperation(BusOperation);
+        // writes to the device addressed at once, outside the bus's timing
+        void writeThrough(const BusOperation&);
         bool hasData();
         uint16_t getWord();
 
+        // cycles to come in which the current transaction neither finishes
+        // nor hands over a word; only transaction mode knows this ahead
+        uint64_t quietCycles();
+        void skipCycles(uint64_t);
+
         uint8_t hasInterrupt();
 
+        void saveState(SnapshotWriter&);
+        void loadState(SnapshotReader&);
+
     private:
         std::shared_ptr<NBusInterface> interface;
 
@@ -44,6 +57,14 @@ class BusUnit {
         BusOperation currentOperation;
 
         uint8_t interruptState;
+
+        // transaction mode: cycles until the current operation completes
+        bool transactionMode;
+        int transactionDelay;
+
+        static int getWriteMode(const BusOperation&);
+        uint32_t getAddress();
+        void startTransaction();
 };
 
 }; // namespace n16r
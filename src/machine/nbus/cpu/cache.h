@@ -2,8 +2,22 @@
 #define SYSNP_CACHE_H
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
+#include <span>
+#include <variant>
 #include <type_traits>
+#include <string>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../../snapshot.h"
+#include "replacement.h"
 
 namespace sysnp {
 
@@ -19,7 +33,15 @@ enum CacheCheck {
     CacheContainsSplit
 };
 
-template<typename A, typename V, typename M, typename F>
+// A line found by lookup(): its set and way, or a way of -1 on a miss.
+struct CacheWay {
+    int set = 0;
+    int way = -1;
+
+    bool isHit() const { return way >= 0; }
+};
+
+template<typename A, typename V, typename M, typename F, typename P = LruPolicy>
     //requires
         //std::is_integral<A>::value && !std::is_signed<A>::value &&
         //std::is_integral<F>::value && !std::is_signed<F>::value
@@ -30,9 +52,13 @@ class Cache {
                 binBits(_binBits), lineBits(_lineBits), wayBits(_wayBits), singleValue(_singleValue),
                 dirtyFlag(_dirtyFlag), presentFlag(_presentFlag),
                 tagMask(0), binMask(0), lineMask(0) {
+            if (wayBits > 5) {
+                throw std::invalid_argument("Caches have at most 32 ways");
+            }
             contentCount = singleValue ? 1 : (1 << lineBits);
 
             wayCount = 1 << wayBits;
+            wayMask = wayCount == 32 ? ~0u : (1u << wayCount) - 1;
             int addressBits = sizeof(A) * 8;
             int tagBits = addressBits - binBits - lineBits;
 
@@ -44,51 +70,60 @@ class Cache {
             binMask  = ((binMask << tagBits) >> (tagBits + lineBits)) << lineBits;
             lineMask = lineMask >> (addressBits - lineBits);
 
-            int binCount = 1 << binBits;
+            binCount = 1 << binBits;
             int entryCount = binCount * wayCount;
 
-            tag     .resize(entryCount, 0);
-            lru     .resize(entryCount, 0);
-            meta    .resize(entryCount);
-            flag    .resize(entryCount, 0);
+            // Each set keeps the tags, metas and flags of all its ways and its
+            // replacement state together, followed by a mask of its present
+            // ways.
+            // Vector loads may run past the last way of a field, but never
+            // past the end of the set.
+            metaOffset    = alignUp(wayCount * sizeof(A), alignof(M));
+            flagOffset    = alignUp(metaOffset + wayCount * sizeof(M), alignof(F));
+            stateOffset   = flagOffset + wayCount * sizeof(F);
+            presentOffset = alignUp(stateOffset + P::stateBytes(wayCount), alignof(uint32_t));
+            setStride     = alignUp(std::max(presentOffset + sizeof(uint32_t), metaOffset + vectorBytes), sizeof(SetBlock));
+
+            sets    .resize(binCount * setStride / sizeof(SetBlock));
             content .resize(entryCount * contentCount);
 
-            tag     .shrink_to_fit();
-            meta    .shrink_to_fit();
-            lru     .shrink_to_fit();
-            flag    .shrink_to_fit();
+            sets    .shrink_to_fit();
             content .shrink_to_fit();
         }
         virtual ~Cache() {}
 
+        // The first present way holding the address's line.
+        CacheWay lookup(A address, M metaValue) {
+            CacheWay found;
+            found.set = setNumber(address);
+            uint32_t ways = matchWays(found.set, address & tagMask, metaValue) & usableWays(found.set);
+            if (ways) {
+                found.way = std::countr_zero(ways);
+            }
+            return found;
+        }
+
         CacheCheck contains(A address, int count, M metaValue) {
+            CacheWay way;
+            return contains(address, count, metaValue, way);
+        }
+        // As above, also handing back the line holding the first address.
+        CacheCheck contains(A address, int count, M metaValue, CacheWay &way) {
             A addressTag = address & tagMask;
             A minBin = address & binMask;
             A maxBin = (address + count - 1) & binMask;
-            int binNumber = (minBin >> lineBits) << wayBits;
 
-            bool startFound = false;
-            for (int w = 0; w < wayCount; w++) {
-                if (tag[binNumber + w] == addressTag && meta[binNumber + w] == metaValue) {
-                    if (presentFlag >= 0 && (flag[binNumber + w] & (1 << presentFlag))) {
-                        startFound = true;
-                        break;
-                    }
-                }
+            way = CacheWay();
+            way.set = minBin >> lineBits;
+            uint32_t startWays = presentFlag >= 0 ? matchWays(way.set, addressTag, metaValue) & present(way.set) : 0;
+            bool startFound = startWays != 0;
+            if (startFound) {
+                way.way = std::countr_zero(startWays);
             }
 
             if (minBin != maxBin) {
-                binNumber = (maxBin >> lineBits) << wayBits;
-
-                bool endFound = false;
-                for (int w = 0; w < wayCount; w++) {
-                    if (tag[binNumber + w] == addressTag && meta[binNumber + w] == metaValue) {
-                        if (presentFlag >= 0 && (flag[binNumber + w] & (1 << presentFlag))) {
-                            endFound = true;
-                            break;
-                        }
-                    }
-                }
+                int endSet = maxBin >> lineBits;
+                bool endFound = presentFlag >= 0 && (matchWays(endSet, addressTag, metaValue) & present(endSet));
 
                 if (startFound && endFound) {
                     return CacheContainsSplit;
@@ -107,54 +142,27 @@ class Cache {
             return CacheContainsNone;
         }
 
-        std::vector<V> get(A address, int count, M metaValue, bool updateLru = false) {
-            std::vector<V> data(count);
-
-            int lastBinNum = -1;
-            int lineIndex = -1;
-            for (int i = 0; i < count; i++) {
+        // Fills values from consecutive addresses; anything not cached reads 0.
+        void get(A address, std::span<V> values, M metaValue, bool updateReplacement = false) {
+            int lastSet = -1;
+            CacheWay line;
+            for (int i = 0; i < values.size(); i++) {
                 A valueAddress = address + i;
-                A addressTag = valueAddress & tagMask;
-                int binNum = binNumber(valueAddress);
-                if (binNum != lastBinNum) {
-                    lastBinNum = binNum;
-                    lineIndex = -1;
-                    for (int w = 0; w < wayCount; w++) {
-                        int offset = binNum + w;
-                        if (tag[offset] == addressTag && meta[offset] == metaValue) {
-                            if (presentFlag >= 0 && !(flag[offset] & (1 << presentFlag))) {
-                                continue;
-                            }
-                            lineIndex = offset;
-                            if (updateLru) {
-                                int8_t oldLru = lru[offset];
-                                for (int wl = 0; wl < wayCount; wl++) {
-                                    if (wl == w) {
-                                        lru[binNum + wl] = wayCount - 1;
-                                    }
-                                    else if (lru[binNum + wl] > oldLru) {
-                                        lru[binNum + wl] -= 1;
-                                    }
-                                }
-                            }
-                            break;
-                        }
+                int set = setNumber(valueAddress);
+                if (set != lastSet) {
+                    lastSet = set;
+                    line = lookup(valueAddress, metaValue);
+                    if (line.isHit() && updateReplacement) {
+                        touch(line);
                     }
                 }
 
-                if (lineIndex >= 0) {
-                    A lineOffset = lineIndex;
-                    if (!singleValue) {
-                        lineOffset <<= lineBits;
-                        lineOffset += valueAddress & lineMask;
-                    }
-                    data[i] = content[lineOffset];
-                }
-                else {
-                    data[i] = 0;
-                }
+                values[i] = line.isHit() ? content[contentOffset(line, valueAddress)] : 0;
             }
-
+        }
+        std::vector<V> get(A address, int count, M metaValue, bool updateReplacement = false) {
+            std::vector<V> data(count);
+            get(address, data, metaValue, updateReplacement);
             return data;
         }
 
@@ -162,157 +170,221 @@ class Cache {
             return get(address, count, metaValue, true);
         }
 
-        void load(A address, M metaValue, F flags, std::vector<V> values) {
+        // Consecutive values folded little-endian into one, as fetch and the
+        // memory stage use them.
+        uint32_t readValue(A address, int count, M metaValue, bool updateReplacement = true) {
+            V values[4 / sizeof(V)];
+            get(address, std::span<V>(values, count), metaValue, updateReplacement);
+
+            uint32_t value = 0;
+            for (int i = count - 1; i >= 0; i--) {
+                value = (value << (8 * sizeof(V))) | values[i];
+            }
+            return value;
+        }
+        uint16_t read16(A address, M metaValue) { return readValue(address, 2 / sizeof(V), metaValue); }
+        uint32_t read32(A address, M metaValue) { return readValue(address, 4 / sizeof(V), metaValue); }
+
+        void load(A address, M metaValue, F flags, std::span<const V> values) {
             int selectedLine = selectLine(address, metaValue);
             load(address, metaValue, flags, selectedLine, values);
         }
-        void load(A address, M metaValue, F flags, int way, std::vector<V> values) {
-            int binNum = binNumber(address);
-            int lineNumber = binNum + way;
-            A lineStartIndex = lineNumber;
-            if (!singleValue) {
-                lineStartIndex <<= lineBits;
-            }
+        void load(A address, M metaValue, F flags, int way, std::span<const V> values) {
+            CacheWay line;
+            line.set = setNumber(address);
+            line.way = way;
 
+            A lineStartIndex = contentOffset(line, address & ~lineMask);
             for (int i = 0; i < contentCount && i < values.size(); i++) {
                 content[lineStartIndex + i] = values[i];
             }
 
-            tag  [lineNumber] = address & tagMask;
-            meta [lineNumber] = metaValue;
-            flag [lineNumber] = flags;
+            tags (line.set)[way] = address & tagMask;
+            metas(line.set)[way] = metaValue;
+            setFlags(line, presentFlag >= 0 ? flags | (1 << presentFlag) : flags);
 
-            auto oldLru = lru[lineNumber];
-            lru[lineNumber] = (wayCount) - 1;
-
-            if (presentFlag >= 0) {
-                flag[lineNumber] |= (1 << presentFlag);
-            }
-
-            for (int i = 0; i < wayCount; i++) {
-                if (i == way) {
-                    continue;
-                }
-                if (lru[binNum + i] > oldLru) {
-                    lru[binNum + i]--;
-                }
-            }
+            policy.insert(replacement(line.set), wayCount, line.way);
         }
 
-        void write(A address, M metaValue, std::vector<V> values) {
-            int lastBinNum = -1;
-            int lineIndex = -1;
+        // Writes into the lines already holding the addresses, marking them
+        // dirty unless the values are already on their way to memory.
+        void write(A address, M metaValue, std::span<const V> values, bool markDirty = true) {
+            int lastSet = -1;
+            CacheWay line;
             for (int i = 0; i < values.size(); i++) {
                 A valueAddress = address + i;
-                A addressTag = valueAddress & tagMask;
-                int binNum = binNumber(valueAddress);
-                if (binNum != lastBinNum) {
-                    lastBinNum = binNum;
-                    if (lastBinNum >= 0 && lineIndex >= 0 && dirtyFlag >= 0) {
-                        flag[lineIndex] &= ~(1 << dirtyFlag);
-                    }
-                    lineIndex = -1;
-                    for (int w = 0; w < wayCount; w++) {
-                        int offset = binNum + w;
-                        if (presentFlag >= 0 && !(flag[offset] & (1 << presentFlag))) {
-                            continue;
-                        }
-                        if (tag[offset] == addressTag && meta[offset] == metaValue) {
-                            lineIndex = offset;
-
-                            if (dirtyFlag >= 0) {
-                                flag[lineIndex] |= (1 << dirtyFlag);
-                            }
-
-                            int8_t oldLru = lru[offset];
-                            for (int wl = 0; wl < wayCount; wl++) {
-                                if (wl == w) {
-                                    lru[binNum + wl] = wayCount - 1;
-                                }
-                                else if (lru[binNum + wl] > oldLru) {
-                                    lru[binNum + wl] -= 1;
-                                }
-                            }
-                            break;
+                int set = setNumber(valueAddress);
+                if (set != lastSet) {
+                    lastSet = set;
+                    line = lookup(valueAddress, metaValue);
+                    if (line.isHit()) {
+                        if (dirtyFlag >= 0 && markDirty) {
+                            setFlags(line, flags(line.set)[line.way] | (1 << dirtyFlag));
                         }
+                        touch(line);
                     }
                 }
 
-                if (lineIndex >= 0) {
-                    A lineOffset = lineIndex;
-                    if (!singleValue) {
-                        lineOffset <<= lineBits;
-                        lineOffset += valueAddress & lineMask;
-                    }
-                    content[lineOffset] = values[i];
+                if (line.isHit()) {
+                    content[contentOffset(line, valueAddress)] = values[i];
                 }
             }
         }
 
+        F getFlags(CacheWay line) {
+            return line.isHit() ? flags(line.set)[line.way] : 0;
+        }
         F getFlags(A address, M metaValue) {
-            address &= tagMask;
-            int binNum = binNumber(address);
-            for (int i = 0; i < wayCount; i++) {
-                int offset = binNum + i;
-                if (meta[offset] == metaValue && tag[offset] == address) {
-                    return flag[offset];
-                }
-            }
-            return 0;
+            int set = setNumber(address);
+            uint32_t ways = matchWays(set, address & tagMask, metaValue);
+            return ways ? flags(set)[std::countr_zero(ways)] : 0;
         }
 
         A getLineMask() { return lineMask; }
         int getLineBytes() { return contentCount; }
 
         int selectLine(A address, M metaValue) {
-            int binNum = binNumber(address);
+            int set = setNumber(address);
 
             if (presentFlag >= 0) {
-                F flagMask = (1 << presentFlag);
-                for (int i = 0; i < wayCount; i++) {
-                    if (!(flag[binNum + i] & flagMask)) {
-                        return i;
-                    }
+                uint32_t absent = ~present(set) & wayMask;
+                if (absent) {
+                    return std::countr_zero(absent);
                 }
             }
-            for (int i = 0; i < wayCount; i++) {
-                if (lru[binNum + i] == 0) {
-                    return i;
-                }
+            return policy.victim(replacement(set), wayCount);
+        }
+
+        CacheWay selectWay(A address, M metaValue) {
+            return {setNumber(address), selectLine(address, metaValue)};
+        }
+        // The start address and meta of the line held in a way, if it holds one.
+        bool lineAt(CacheWay line, A &address, M &metaValue) {
+            if (!line.isHit() || !(usableWays(line.set) & (1u << line.way))) {
+                return false;
             }
-            return 0;
+            address = tags(line.set)[line.way] | ((A) line.set << lineBits);
+            metaValue = metas(line.set)[line.way];
+            return true;
         }
 
+        bool isWriteBack() { return dirtyFlag >= 0; }
+        bool isDirty(CacheWay line) {
+            return dirtyFlag >= 0 && line.isHit() && (flags(line.set)[line.way] & (1 << dirtyFlag));
+        }
+        void clean(CacheWay line) {
+            if (isDirty(line)) {
+                setFlags(line, flags(line.set)[line.way] & ~(1 << dirtyFlag));
+            }
+        }
+        void clearFlags(CacheWay line, F mask) {
+            if (line.isHit()) {
+                setFlags(line, flags(line.set)[line.way] & ~mask);
+            }
+        }
+        int getSetCount() { return binCount; }
+        int getWayCount() { return wayCount; }
+
         bool lineDirty(A address, int line) {
             if (dirtyFlag < 0) {
                 return false;
             }
 
-            int offset = binNumber(address) + line;
-            return (flag[offset] & (1 << dirtyFlag)) > 0;
+            return (flags(setNumber(address))[line] & (1 << dirtyFlag)) > 0;
         }
 
         void flush(A address, M metaValue) {
-            int binNum = binNumber(address);
-            A addressTag = address & tagMask;
-            for (int i = 0; i < wayCount; i++) {
-                if (tag[binNum + i] == addressTag && meta[binNum + i] == metaValue) {
-                    flag[binNum + i] = 0;
-                }
+            CacheWay line;
+            line.set = setNumber(address);
+            uint32_t ways = matchWays(line.set, address & tagMask, metaValue);
+            while (ways) {
+                line.way = std::countr_zero(ways);
+                ways &= ways - 1;
+                setFlags(line, 0);
             }
         }
         void flush() {
-            for (int i = 0; i < flag.size(); i++) {
-                flag[i] = 0;
+            for (int set = 0; set < binCount; set++) {
+                std::fill_n(flags(set), wayCount, 0);
+                present(set) = 0;
+            }
+        }
+
+        // Snapshots keep the field-by-field layout, one entry per line.
+        void saveState(SnapshotWriter &snapshot) {
+            std::vector<A     > tag;
+            std::vector<M     > meta;
+            std::vector<F     > flag;
+            std::vector<uint8_t> state;
+            for (int set = 0; set < binCount; set++) {
+                tag .insert(tag .end(), tags (set), tags (set) + wayCount);
+                meta.insert(meta.end(), metas(set), metas(set) + wayCount);
+                flag.insert(flag.end(), flags(set), flags(set) + wayCount);
+                state.insert(state.end(), replacement(set), replacement(set) + P::stateBytes(wayCount));
+            }
+
+            snapshot.write(tag);
+            snapshot.write(meta);
+            snapshot.write(content);
+            snapshot.write(flag);
+            snapshot.write(state);
+            policy.saveState(snapshot);
+        }
+        void loadState(SnapshotReader &snapshot) {
+            size_t entryCount = binCount * wayCount;
+            size_t stateSize = binCount * P::stateBytes(wayCount);
+            size_t contentSize = content.size();
+
+            std::vector<A     > tag;
+            std::vector<M     > meta;
+            std::vector<F     > flag;
+            std::vector<uint8_t> state;
+
+            snapshot.read(tag);
+            snapshot.read(meta);
+            snapshot.read(content);
+            snapshot.read(flag);
+            snapshot.read(state);
+            policy.loadState(snapshot);
+
+            if (tag.size() != entryCount || meta.size() != entryCount || flag.size() != entryCount ||
+                    state.size() != stateSize || content.size() != contentSize) {
+                throw std::runtime_error("Snapshot doesn't match the configured cache geometry");
+            }
+
+            for (int set = 0; set < binCount; set++) {
+                std::copy_n(tag .begin() + set * wayCount, wayCount, tags (set));
+                std::copy_n(meta.begin() + set * wayCount, wayCount, metas(set));
+                std::copy_n(state.begin() + set * P::stateBytes(wayCount), P::stateBytes(wayCount), replacement(set));
+                for (int w = 0; w < wayCount; w++) {
+                    setFlags({set, w}, flag[set * wayCount + w]);
+                }
             }
         }
 
     private:
-        std::vector<A     > tag;
-        std::vector<M     > meta;
-        std::vector<V     > content;
-        std::vector<F     > flag;
-        std::vector<int8_t> lru;
+        struct alignas(64) SetBlock {
+            uint8_t bytes[64];
+        };
+
+#if defined(__AVX2__)
+        const static int vectorLanes = 8;
+#elif defined(__SSE2__)
+        const static int vectorLanes = 4;
+#else
+        const static int vectorLanes = 1;
+#endif
+        const static size_t vectorBytes = vectorLanes * 4;
+
+        std::vector<SetBlock> sets;
+        std::vector<V       > content;
+        P policy;
+
+        size_t metaOffset = 0;
+        size_t flagOffset = 0;
+        size_t stateOffset = 0;
+        size_t presentOffset = 0;
+        size_t setStride = 0;
 
         A tagMask;
         A binMask;
@@ -322,13 +394,186 @@ class Cache {
         int lineBits;
         int wayBits;
 
-        int wayCount;
+        int binCount = 0;
+        int wayCount = 0;
+        uint32_t wayMask = 0;
         int contentCount;
         bool singleValue;
         int dirtyFlag;
         int presentFlag;
 
-        int binNumber(A address) { return ((address & binMask) >> lineBits) << wayBits; }
+        static size_t alignUp(size_t offset, size_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        uint8_t  *setBase(int set) { return reinterpret_cast<uint8_t*>(sets.data()) + set * setStride; }
+        A        *tags   (int set) { return reinterpret_cast<A*>(setBase(set)); }
+        M        *metas  (int set) { return reinterpret_cast<M*>(setBase(set) + metaOffset); }
+        F        *flags  (int set) { return reinterpret_cast<F*>(setBase(set) + flagOffset); }
+        uint8_t  *replacement(int set) { return setBase(set) + stateOffset; }
+        uint32_t &present(int set) { return *reinterpret_cast<uint32_t*>(setBase(set) + presentOffset); }
+
+        // ways a lookup may return: any of them if lines aren't marked present
+        uint32_t usableWays(int set) { return presentFlag >= 0 ? present(set) : wayMask; }
+
+        // Ways whose tag and meta both match, compared a vector of ways at a
+        // time when both are 32 bits wide.
+        uint32_t matchWays(int set, A addressTag, M metaValue) {
+            const A *tag = tags(set);
+            const M *meta = metas(set);
+            uint32_t ways = 0;
+#if defined(__AVX2__)
+            if constexpr (sizeof(A) == 4 && sizeof(M) == 4) {
+                __m256i tagKey  = _mm256_set1_epi32(addressTag);
+                __m256i metaKey = _mm256_set1_epi32(metaValue);
+                for (int w = 0; w < wayCount; w += vectorLanes) {
+                    __m256i tagHit  = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (tag + w)), tagKey);
+                    __m256i metaHit = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (meta + w)), metaKey);
+                    ways |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(tagHit, metaHit))) << w;
+                }
+                return ways & wayMask;
+            }
+#elif defined(__SSE2__)
+            if constexpr (sizeof(A) == 4 && sizeof(M) == 4) {
+                __m128i tagKey  = _mm_set1_epi32(addressTag);
+                __m128i metaKey = _mm_set1_epi32(metaValue);
+                for (int w = 0; w < wayCount; w += vectorLanes) {
+                    __m128i tagHit  = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (tag + w)), tagKey);
+                    __m128i metaHit = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (meta + w)), metaKey);
+                    ways |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(tagHit, metaHit))) << w;
+                }
+                return ways & wayMask;
+            }
+#endif
+            for (int w = 0; w < wayCount; w++) {
+                if (tag[w] == addressTag && meta[w] == metaValue) {
+                    ways |= 1u << w;
+                }
+            }
+            return ways;
+        }
+
+        void setFlags(CacheWay line, F value) {
+            flags(line.set)[line.way] = value;
+            if (presentFlag >= 0 && (value & (1 << presentFlag))) {
+                present(line.set) |= 1u << line.way;
+            }
+            else {
+                present(line.set) &= ~(1u << line.way);
+            }
+        }
+
+        void touch(CacheWay line) {
+            policy.touch(replacement(line.set), wayCount, line.way);
+        }
+
+        A contentOffset(CacheWay line, A address) {
+            A offset = (line.set << wayBits) + line.way;
+            if (!singleValue) {
+                offset <<= lineBits;
+                offset += address & lineMask;
+            }
+            return offset;
+        }
+
+        int setNumber(A address) { return (address & binMask) >> lineBits; }
+};
+
+// A cache whose replacement policy is picked at run time, from the
+// configuration. Each policy still gets its own Cache instantiation.
+template<typename A, typename V, typename M, typename F>
+class ConfiguredCache {
+    public:
+        ConfiguredCache() {}
+        ConfiguredCache(ReplacementPolicy policy, int binBits, int lineBits, int wayBits, bool singleValue, int dirtyFlag, int presentFlag) {
+            switch (policy) {
+                case ReplaceTreePlru: cache.template emplace<Cache<A, V, M, F, TreePlruPolicy>>(binBits, lineBits, wayBits, singleValue, dirtyFlag, presentFlag); break;
+                case ReplaceRandom:   cache.template emplace<Cache<A, V, M, F, RandomPolicy  >>(binBits, lineBits, wayBits, singleValue, dirtyFlag, presentFlag); break;
+                case ReplaceFifo:     cache.template emplace<Cache<A, V, M, F, FifoPolicy    >>(binBits, lineBits, wayBits, singleValue, dirtyFlag, presentFlag); break;
+                case ReplaceSrrip:    cache.template emplace<Cache<A, V, M, F, SrripPolicy   >>(binBits, lineBits, wayBits, singleValue, dirtyFlag, presentFlag); break;
+                default:              cache.template emplace<Cache<A, V, M, F, LruPolicy     >>(binBits, lineBits, wayBits, singleValue, dirtyFlag, presentFlag); break;
+            }
+        }
+
+        CacheWay lookup(A address, M metaValue) {
+            return std::visit([&](auto &c) { return c.lookup(address, metaValue); }, cache);
+        }
+        CacheCheck contains(A address, int count, M metaValue) {
+            return std::visit([&](auto &c) { return c.contains(address, count, metaValue); }, cache);
+        }
+        CacheCheck contains(A address, int count, M metaValue, CacheWay &way) {
+            return std::visit([&](auto &c) { return c.contains(address, count, metaValue, way); }, cache);
+        }
+        uint32_t readValue(A address, int count, M metaValue, bool updateReplacement = true) {
+            return std::visit([&](auto &c) { return c.readValue(address, count, metaValue, updateReplacement); }, cache);
+        }
+        void get(A address, std::span<V> values, M metaValue, bool updateReplacement = false) {
+            std::visit([&](auto &c) { c.get(address, values, metaValue, updateReplacement); }, cache);
+        }
+        void load(A address, M metaValue, F flags, std::span<const V> values) {
+            std::visit([&](auto &c) { c.load(address, metaValue, flags, values); }, cache);
+        }
+        void load(A address, M metaValue, F flags, int way, std::span<const V> values) {
+            std::visit([&](auto &c) { c.load(address, metaValue, flags, way, values); }, cache);
+        }
+        CacheWay selectWay(A address, M metaValue) {
+            return std::visit([&](auto &c) { return c.selectWay(address, metaValue); }, cache);
+        }
+        bool lineAt(CacheWay line, A &address, M &metaValue) {
+            return std::visit([&](auto &c) { return c.lineAt(line, address, metaValue); }, cache);
+        }
+        void flush(A address, M metaValue) {
+            std::visit([&](auto &c) { c.flush(address, metaValue); }, cache);
+        }
+        void flush() {
+            std::visit([&](auto &c) { c.flush(); }, cache);
+        }
+        void write(A address, M metaValue, std::span<const V> values, bool markDirty = true) {
+            std::visit([&](auto &c) { c.write(address, metaValue, values, markDirty); }, cache);
+        }
+        bool isWriteBack() {
+            return std::visit([&](auto &c) { return c.isWriteBack(); }, cache);
+        }
+        bool isDirty(CacheWay line) {
+            return std::visit([&](auto &c) { return c.isDirty(line); }, cache);
+        }
+        void clean(CacheWay line) {
+            std::visit([&](auto &c) { c.clean(line); }, cache);
+        }
+        void clearFlags(CacheWay line, F mask) {
+            std::visit([&](auto &c) { c.clearFlags(line, mask); }, cache);
+        }
+        int getSetCount() {
+            return std::visit([&](auto &c) { return c.getSetCount(); }, cache);
+        }
+        int getWayCount() {
+            return std::visit([&](auto &c) { return c.getWayCount(); }, cache);
+        }
+        F getFlags(CacheWay line) {
+            return std::visit([&](auto &c) { return c.getFlags(line); }, cache);
+        }
+        A getLineMask() {
+            return std::visit([&](auto &c) { return c.getLineMask(); }, cache);
+        }
+        int getLineBytes() {
+            return std::visit([&](auto &c) { return c.getLineBytes(); }, cache);
+        }
+
+        void saveState(SnapshotWriter &snapshot) {
+            std::visit([&](auto &c) { c.saveState(snapshot); }, cache);
+        }
+        void loadState(SnapshotReader &snapshot) {
+            std::visit([&](auto &c) { c.loadState(snapshot); }, cache);
+        }
+
+    private:
+        std::variant<
+            Cache<A, V, M, F, LruPolicy     >,
+            Cache<A, V, M, F, TreePlruPolicy>,
+            Cache<A, V, M, F, RandomPolicy  >,
+            Cache<A, V, M, F, FifoPolicy    >,
+            Cache<A, V, M, F, SrripPolicy   >
+        > cache;
 };
 
 }; // namespace n16r
@@ -9,15 +9,52 @@ namespace nbus {
 
 namespace n16r {
 
-MemoryUnit::MemoryUnit():tlb(4, 12, 1, true, -1, 0) {}
+MemoryUnit::MemoryUnit():slots(taggedSlots), ring(taggedSlots), ringPositions(taggedSlots), ringHead(0), queuedCount(0), tlb(4, 12, 1, true, -1, 0),
+    levelTwoLatency(4), levelTwoInclusion(InclusiveCache), levelTwoHits(0), levelTwoMisses(0),
+    absorbedWrites(0), writeBacks(0), storeBufferDepth(0), coalescedWrites(0), forwardedLoads(0),
+    prefetchDepth(0), fetchAddress(0), fetchAsid(0), prefetchesIssued(0), usefulPrefetches(0), wastedPrefetches(0),
+    criticalWordFirst(false), earlyRestarts(0),
+    codeGeneration(0) {
+    rebuildFreeSlots();
+}
 
-void MemoryUnit::setCache(CacheType type, int _addressBits, int _binBits, int _lineBits, int _ways) {
+void MemoryUnit::setCache(CacheType type, int _addressBits, int _binBits, int _lineBits, int _ways, ReplacementPolicy _policy, CacheMode _mode) {
     int _wayBits = 0;
     while (_ways > 1) {
         _wayBits++;
         _ways >>= 1;
     }
-    caches.emplace(std::piecewise_construct, std::forward_as_tuple(type), std::forward_as_tuple(_binBits, _lineBits, _wayBits, false, -1, 0));
+    if (type == InstructionCache && _mode == WriteBackCache) {
+        throw std::invalid_argument("The instruction cache can't be write-back");
+    }
+    // dirty lines are marked with CACHE_FLAG_DIRTY
+    int _dirtyFlag = _mode == WriteBackCache ? 1 : -1;
+    caches.emplace(std::piecewise_construct, std::forward_as_tuple(type), std::forward_as_tuple(_policy, _binBits, _lineBits, _wayBits, false, _dirtyFlag, 0));
+
+    // lines move between the levels whole
+    if (caches.contains(UnifiedL2Cache)) {
+        for (auto &[other, cache]: caches) {
+            if (cache.getLineBytes() != caches[UnifiedL2Cache].getLineBytes()) {
+                throw std::invalid_argument("The L2 cache must have the same line size as the L1 caches");
+            }
+        }
+    }
+}
+void MemoryUnit::setLevelTwo(int latency, CacheInclusion inclusion) {
+    levelTwoLatency = latency;
+    levelTwoInclusion = inclusion;
+}
+
+void MemoryUnit::setStoreBuffer(int depth) {
+    storeBufferDepth = depth;
+}
+
+void MemoryUnit::setPrefetch(int depth) {
+    prefetchDepth = depth;
+}
+
+void MemoryUnit::setCriticalWordFirst(bool enabled) {
+    criticalWordFirst = enabled;
 }
 
 void MemoryUnit::addNoCacheRegion(uint32_t start, uint32_t length) {
@@ -25,7 +62,140 @@ void MemoryUnit::addNoCacheRegion(uint32_t start, uint32_t length) {
     noCacheRegions.push_back(region);
 }
 
+void MemoryUnit::saveState(SnapshotWriter &snapshot) {
+    snapshot.write<uint64_t>(slots.size());
+    for (auto &op: slots) {
+        op.saveState(snapshot);
+    }
+    snapshot.write(queuedCount);
+    for (int i = 0; i < queuedCount; i++) {
+        snapshot.write(ring[(ringHead + i) & (ring.size() - 1)]);
+    }
+    pendingOperation.saveState(snapshot);
+    lastUncachedRead.saveState(snapshot);
+
+    for (auto &[type, cache]: caches) {
+        cache.saveState(snapshot);
+    }
+    tlb.saveState(snapshot);
+
+    snapshot.write<uint64_t>(levelTwoFills.size());
+    for (auto &fill: levelTwoFills) {
+        fill.operation.saveState(snapshot);
+        snapshot.write(fill.cycles);
+        snapshot.write(fill.dirty);
+    }
+    snapshot.write(levelTwoHits);
+    snapshot.write(levelTwoMisses);
+    snapshot.write(absorbedWrites);
+    snapshot.write(writeBacks);
+    snapshot.write(coalescedWrites);
+    snapshot.write(forwardedLoads);
+    snapshot.write(fetchAddress);
+    snapshot.write(fetchAsid);
+    snapshot.write(prefetchesIssued);
+    snapshot.write(usefulPrefetches);
+    snapshot.write(wastedPrefetches);
+    snapshot.write(earlyRestarts);
+}
+void MemoryUnit::loadState(SnapshotReader &snapshot) {
+    slots.resize(snapshot.read<uint64_t>());
+    if (slots.size() < taggedSlots) {
+        throw std::runtime_error("Snapshot doesn't match this machine: memory operations");
+    }
+    for (auto &op: slots) {
+        op.loadState(snapshot);
+    }
+    snapshot.read(queuedCount);
+    size_t ringSize = taggedSlots;
+    while (ringSize < (size_t) queuedCount) {
+        ringSize *= 2;
+    }
+    ring.assign(ringSize, 0);
+    ringHead = 0;
+    for (int i = 0; i < queuedCount; i++) {
+        snapshot.read(ring[i]);
+    }
+    pendingOperation.loadState(snapshot);
+    lastUncachedRead.loadState(snapshot);
+
+    for (auto &[type, cache]: caches) {
+        cache.loadState(snapshot);
+    }
+    tlb.loadState(snapshot);
+
+    levelTwoFills.resize(snapshot.read<uint64_t>());
+    for (auto &fill: levelTwoFills) {
+        fill.operation.loadState(snapshot);
+        snapshot.read(fill.cycles);
+        snapshot.read(fill.dirty);
+    }
+    snapshot.read(levelTwoHits);
+    snapshot.read(levelTwoMisses);
+    snapshot.read(absorbedWrites);
+    snapshot.read(writeBacks);
+    snapshot.read(coalescedWrites);
+    snapshot.read(forwardedLoads);
+    snapshot.read(fetchAddress);
+    snapshot.read(fetchAsid);
+    snapshot.read(prefetchesIssued);
+    snapshot.read(usefulPrefetches);
+    snapshot.read(wastedPrefetches);
+    snapshot.read(earlyRestarts);
+
+    rebuildFreeSlots();
+}
+void MemoryUnit::saveGeometry(SnapshotWriter &snapshot) {
+    snapshot.write<uint64_t>(caches.size());
+    for (auto &[type, cache]: caches) {
+        snapshot.write(type);
+        snapshot.write(cache.getSetCount());
+        snapshot.write(cache.getWayCount());
+        snapshot.write(cache.getLineBytes());
+    }
+}
+
+void MemoryOperation::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(operationId);
+    snapshot.write(inAddress);
+    snapshot.write(outAddress);
+    snapshot.write(asid);
+    data.saveState(snapshot);
+    snapshot.write(bytes);
+    snapshot.write(type);
+    snapshot.write(committed);
+    snapshot.write(prefetch);
+    snapshot.write(criticalByte);
+}
+void MemoryOperation::loadState(SnapshotReader &snapshot) {
+    snapshot.read(operationId);
+    snapshot.read(inAddress);
+    snapshot.read(outAddress);
+    snapshot.read(asid);
+    data.loadState(snapshot);
+    snapshot.read(bytes);
+    snapshot.read(type);
+    snapshot.read(committed);
+    snapshot.read(prefetch);
+    snapshot.read(criticalByte);
+}
+
+void OperationData::saveState(SnapshotWriter &snapshot) const {
+    snapshot.write<uint64_t>(count);
+    snapshot.writeBytes(data(), count);
+}
+void OperationData::loadState(SnapshotReader &snapshot) {
+    clear();
+    resize(snapshot.read<uint64_t>());
+    snapshot.readBytes(data(), count);
+}
+
 MemoryCheck MemoryUnit::check(MemoryOpType type, uint32_t address, int count, uint32_t asid) {
+    if (type == MemoryOpInstructionRead) {
+        fetchAddress = address;
+        fetchAsid = asid;
+    }
+
     if (!canCache(address, asid)) {
         if (lastUncachedRead.isValid() && lastUncachedRead.inAddress == (lastUncachedRead.inAddress & address)) {
             return MemoryCheckContainsSingle;
@@ -35,23 +205,23 @@ MemoryCheck MemoryUnit::check(MemoryOpType type, uint32_t address, int count, ui
 
     CacheType cacheType = type == MemoryOpInstructionRead ? InstructionCache : DataCache;
 
-    auto pendingContains = pendingOperation.contains(cacheType, address, count, asid);
-    if (pendingContains != CacheContainsNone) {
-        return pendingContains;
-    }
-
     // Check if it's in the cache
     CacheCheck cacheResult = CacheContainsNone;
+    CacheWay cacheLine;
     if (caches.contains(cacheType)) {
-        cacheResult = caches[cacheType].contains(address, count, asid);
+        cacheResult = caches[cacheType].contains(address, count, asid, cacheLine);
     }
 
     // Cache Hit -- return the hit
     if (cacheResult >= CacheContainsSingle) {
         // Check modes
-        auto cacheFlags = caches[cacheType].getFlags(address, asid);
+        auto cacheFlags = caches[cacheType].getFlags(cacheLine);
         switch (type) {
             case MemoryOpInstructionRead:
+                if (cacheFlags & CACHE_FLAG_PREFETCH) {
+                    usefulPrefetches++;
+                    caches[cacheType].clearFlags(cacheLine, CACHE_FLAG_PREFETCH);
+                }
                 if (cacheFlags & CACHE_FLAG_NOEXEC) {
                     return MemoryCheckNoExecute;
                 }
@@ -80,7 +250,7 @@ MemoryCheck MemoryUnit::check(MemoryOpType type, uint32_t address, int count, ui
     auto translateResult = translateAddress(address, count, asid, outAddress);
     if (translateResult.isComplete()) {
         // TLB Hit -- check for modes
-        auto tlbFlags = tlb.getFlags(address, asid);
+        auto tlbFlags = lineFlags(address, asid);
         switch (type) {
             case MemoryOpInstructionRead:
                 if (tlbFlags & CACHE_FLAG_NOEXEC) {
@@ -103,6 +273,13 @@ MemoryCheck MemoryUnit::check(MemoryOpType type, uint32_t address, int count, ui
             default:
                 break;
         }
+        if (type != MemoryOpDataWrite && criticalWordFirst && pendingOperation.contains(cacheType, address, count, asid) == CacheContainsSingle) {
+            return MemoryCheckContainsSingle;
+        }
+        uint32_t forwarded;
+        if (type == MemoryOpDataRead && forwardStores(address, count, asid, forwarded)) {
+            return MemoryCheckContainsSingle;
+        }
         return cacheResult;
     }
     else if (translateResult.result == MemoryCheckSegmentError) {
@@ -117,41 +294,50 @@ MemoryCheck MemoryUnit::check(MemoryOpType type, uint32_t address, int count, ui
 uint32_t MemoryUnit::read(CacheType type, uint32_t address, int count, uint32_t asid) {
     if (lastUncachedRead.isValid() && lastUncachedRead.inAddress == (lastUncachedRead.inAddress & address)) {
         uint32_t value = 0;
-        for (auto iter = lastUncachedRead.data.crbegin(); iter != lastUncachedRead.data.crend(); iter++) {
+        for (int i = lastUncachedRead.data.size() - 1; i >= 0; i--) {
             value <<= 8;
-            value |= *iter;
+            value |= lastUncachedRead.data[i];
         }
 
         lastUncachedRead.invalidate();
         return value;
     }
 
-    if (caches[type].contains(address, count, asid) != CacheContainsNone) {
-        return convert(caches[type].read(address, count, asid));
+    auto held = caches[type].contains(address, count, asid);
+    if (held == CacheContainsSingle || held == CacheContainsSplit) {
+        return caches[type].readValue(address, count, asid);
     }
-    return 0;
-}
 
-uint32_t MemoryUnit::convert(std::vector<uint8_t> content) {
-    uint32_t value = 0;
+    if (criticalWordFirst && pendingOperation.contains(type, address, count, asid) == CacheContainsSingle) {
+        earlyRestarts++;
+        return pendingOperation.readValue(address, count);
+    }
 
-    for (auto iter = content.crbegin(); iter != content.crend(); iter++) {
-        value <<= 8;
-        value |= *iter;
+    uint32_t value;
+    if (type == DataCache && forwardStores(address, count, asid, value)) {
+        forwardedLoads++;
+        return value;
     }
 
-    return value;
+    if (held != CacheContainsNone) {
+        return caches[type].readValue(address, count, asid);
+    }
+    return 0;
 }
 
-uint16_t MemoryUnit::queueRead(MemoryReadType type, uint32_t address, int count, uint32_t asid) {
+uint16_t MemoryUnit::queueRead(MemoryReadType type, uint32_t address, int count, uint32_t asid, bool prefetch) {
     auto alreadyQueued = isReadQueued(type, address, asid);
     if (alreadyQueued) {
         return alreadyQueued;
     }
 
     int bytes = count;
+    int criticalByte = -1;
     CacheType cacheType = type == InstructionRead ? InstructionCache : DataCache;
     if (canCache(address, asid) && caches.contains(cacheType)) {
+        if (criticalWordFirst && !prefetch) {
+            criticalByte = address & caches[cacheType].getLineMask() & ~1;
+        }
         address = address & ~caches[cacheType].getLineMask();
         bytes   =            caches[cacheType].getLineBytes();
     }
@@ -164,64 +350,288 @@ uint16_t MemoryUnit::queueRead(MemoryReadType type, uint32_t address, int count,
     operation.bytes   = bytes;
     operation.type    = type == InstructionRead ? MemoryOpInstructionRead : MemoryOpDataRead;
     operation.committed = true;
+    operation.prefetch = prefetch;
+    operation.criticalByte = criticalByte;
+
+    if (canCache(address, asid) && caches.contains(cacheType) && caches.contains(UnifiedL2Cache)) {
+        auto &levelTwo = caches[UnifiedL2Cache];
+        if (levelTwo.contains(address, bytes, asid) != CacheContainsSingle) {
+            uint16_t operationId = queueOperation(operation);
+            if (operationId != MemoryOperation::invalidOperationId) {
+                levelTwoMisses++;
+            }
+            return operationId;
+        }
+        int slot = allocateSlot(true);
+        if (slot < 0) {
+            return MemoryOperation::invalidOperationId;
+        }
+        levelTwoHits++;
+
+        operation.data.resize(bytes);
+        levelTwo.get(address, operation.data, asid, true);
+
+        // a line leaving an exclusive L2 takes its dirty data with it
+        bool dirty = false;
+        if (levelTwoInclusion == ExclusiveCache) {
+            dirty = levelTwo.isDirty(levelTwo.lookup(address, asid));
+            levelTwo.flush(address, asid);
+        }
+        operation.operationId = slots[slot].operationId;
+        levelTwoFills.push_back({operation, levelTwoLatency, dirty});
+        return operation.operationId;
+    }
 
     return queueOperation(operation);
 }
 
 uint16_t MemoryUnit::queueOperation(MemoryOperation operation) {
-    std::set<uint16_t> existingIds;
-    uint16_t operationId = 0;
-    int queuedCount = 0;
-    for (auto op: queuedOperations) {
-        existingIds.insert(op.operationId);
-        operationId = op.operationId;
-
+    int queueLimit = operation.type == MemoryOpDataWrite && storeBufferDepth > 0 ? storeBufferDepth : 2;
+    int typeCount = 0;
+    for (int i = 0; i < queuedCount; i++) {
+        auto &op = queued(i);
         if (operation.type == op.type && op.isValid()) {
-            queuedCount++;
-            if (queuedCount > 1) {
+            typeCount++;
+            if (typeCount >= queueLimit) {
                 return MemoryOperation::invalidOperationId;
             }
         }
     }
 
-    do {
-        operationId++;
+    return pushOperation(operation, true);
+}
+void MemoryUnit::commitOperation(uint16_t operationId) {
+    auto op = findOperation(operationId);
+    if (op == nullptr) {
+        return;
     }
-    while (existingIds.contains(operationId) || operationId == MemoryOperation::invalidOperationId);
+    op->committed = true;
+    if (op->type != MemoryOpDataWrite) {
+        return;
+    }
+    if (applyWrite(*op, true)) {
+        // a write-back cache took it; it never goes out on the bus
+        removeQueued(queuedIndex(operationId));
+    }
+    else if (storeBufferDepth > 0) {
+        int index = queuedIndex(operationId);
+        if (coalesceWrite(index)) {
+            removeQueued(index);
+        }
+    }
+}
+void MemoryUnit::invalidateOperation(uint16_t operationId) {
+    if (findOperation(operationId) != nullptr) {
+        removeQueued(queuedIndex(operationId));
+    }
+}
 
-    operation.operationId = operationId;
+MemoryOperation *MemoryUnit::findOperation(uint16_t operationId) {
+    uint16_t slot = operationId & slotMask;
+    if (slot >= slots.size() || slots[slot].operationId != operationId || !slots[slot].isValid()) {
+        return nullptr;
+    }
+    return &slots[slot];
+}
+// Takes a free tagged slot, moving it on a generation, or a write-back slot,
+// doubling those when none are left. Returns -1 when the tagged slots are all
+// in use.
+int MemoryUnit::allocateSlot(bool tagged) {
+    if (!tagged) {
+        if (freeWriteBackSlots.empty()) {
+            size_t size = std::max<size_t>(slots.size() * 2, taggedSlots * 2);
+            if (size > 0x10000) {
+                throw std::runtime_error("Too many memory operations queued");
+            }
+            for (int slot = size - 1; slot >= (int) slots.size(); slot--) {
+                freeWriteBackSlots.push_back(slot);
+            }
+            slots.resize(size);
+            ringPositions.resize(size);
+        }
+        uint16_t slot = freeWriteBackSlots.back();
+        freeWriteBackSlots.pop_back();
+        slots[slot].operationId = MemoryOperation::invalidOperationId;
+        return slot;
+    }
 
-    queuedOperations.insert(queuedOperations.begin(), operation);
+    if (freeSlots.empty()) {
+        return -1;
+    }
+    uint16_t slot = freeSlots.back();
+    freeSlots.pop_back();
 
+    uint16_t generation = slots[slot].operationId >> slotBits;
+    uint16_t operationId;
+    do {
+        generation++;
+        operationId = (generation << slotBits) | slot;
+    }
+    while (operationId == MemoryOperation::invalidOperationId || operationId == 0);
+    slots[slot].operationId = operationId;
+    return slot;
+}
+void MemoryUnit::releaseSlot(uint16_t slot) {
+    slots[slot].invalidate();
+    slots[slot].data.clear();
+    (slot < taggedSlots ? freeSlots : freeWriteBackSlots).push_back(slot);
+}
+// Queues the operation as the newest, returning its ID, or the invalid ID
+// when it needs a tagged slot and there's none free.
+uint16_t MemoryUnit::pushOperation(const MemoryOperation &operation, bool tagged) {
+    int slot = allocateSlot(tagged);
+    if (slot < 0) {
+        return MemoryOperation::invalidOperationId;
+    }
+    uint16_t operationId = slots[slot].operationId;
+    slots[slot] = operation;
+    slots[slot].operationId = operationId;
+
+    if (queuedCount == (int) ring.size()) {
+        std::vector<uint16_t> grown(ring.size() * 2);
+        for (int i = 0; i < queuedCount; i++) {
+            grown[i] = ring[(ringHead + i) & (ring.size() - 1)];
+        }
+        ring = std::move(grown);
+        ringHead = 0;
+        for (int i = 0; i < queuedCount; i++) {
+            ringPositions[ring[i]] = i;
+        }
+    }
+    placeQueued(queuedCount, slot);
+    queuedCount++;
     return operationId;
 }
-void MemoryUnit::commitOperation(uint16_t operationId) {
-    for (MemoryOperation& op: queuedOperations) {
-        if (op.operationId == operationId && op.isValid()) {
-            op.committed = true;
-            if (op.type == MemoryOpDataWrite) {
-                applyWrite(op);
-            }
-            break;
+void MemoryUnit::placeQueued(int index, uint16_t slot) {
+    int position = (ringHead + index) & (ring.size() - 1);
+    ring[position] = slot;
+    ringPositions[slot] = position;
+}
+void MemoryUnit::removeQueued(int index) {
+    uint16_t slot = ring[(ringHead + index) & (ring.size() - 1)];
+    if (index == 0) {
+        ringHead = (ringHead + 1) & (ring.size() - 1);
+    }
+    else {
+        for (int i = index; i < queuedCount - 1; i++) {
+            placeQueued(i, ring[(ringHead + i + 1) & (ring.size() - 1)]);
         }
     }
+    queuedCount--;
+    releaseSlot(slot);
 }
-void MemoryUnit::invalidateOperation(uint16_t operationId) {
-    for (auto iter = queuedOperations.begin(); iter != queuedOperations.end(); iter++) {
-        if (iter->operationId == operationId) {
-            queuedOperations.erase(iter);
-            break;
+// Where a queued operation sits, from its slot's place in the ring.
+int MemoryUnit::queuedIndex(uint16_t operationId) {
+    return (ringPositions[operationId & slotMask] - ringHead) & (ring.size() - 1);
+}
+// Slots not queued and not held by an L2 fill are free.
+void MemoryUnit::rebuildFreeSlots() {
+    ringPositions.assign(slots.size(), 0);
+    std::vector<bool> used(slots.size());
+    for (int i = 0; i < queuedCount; i++) {
+        used[ring[i]] = true;
+        ringPositions[ring[i]] = i;
+    }
+    for (auto &fill: levelTwoFills) {
+        used[fill.operation.operationId & slotMask] = true;
+    }
+
+    freeSlots.clear();
+    freeWriteBackSlots.clear();
+    for (int slot = slots.size() - 1; slot >= 0; slot--) {
+        if (!used[slot]) {
+            (slot < taggedSlots ? freeSlots : freeWriteBackSlots).push_back(slot);
         }
     }
 }
 
+// Merges the committed write at index into the nearest older committed write
+// it touches, so long as the two cover one contiguous run within a cache
+// line's worth of aligned memory. It can't pass I/O, or anything else using
+// its bytes. Returns whether it was merged.
+bool MemoryUnit::coalesceWrite(int index) {
+    auto &write = queued(index);
+    if (!canCache(write.inAddress, write.asid)) {
+        return false;
+    }
+
+    uint32_t block = caches.contains(DataCache) ? caches[DataCache].getLineBytes() : 16;
+    uint32_t writeEnd = write.inAddress + write.data.size();
+
+    for (int i = index - 1; i >= 0; i--) {
+        auto &op = queued(i);
+        uint32_t opEnd = op.inAddress + (op.type == MemoryOpDataWrite ? op.data.size() : op.bytes);
+        bool overlaps = op.inAddress < writeEnd && write.inAddress < opEnd;
+
+        if (!canCache(op.inAddress, op.asid)) {
+            return false;
+        }
+        if (op.type != MemoryOpDataWrite || !op.committed || op.asid != write.asid) {
+            if (overlaps) {
+                return false;
+            }
+            continue;
+        }
+
+        uint32_t start = std::min(op.inAddress, write.inAddress);
+        uint32_t end   = std::max(opEnd, writeEnd);
+        bool touches = op.inAddress <= writeEnd && write.inAddress <= opEnd;
+        bool sameBlock = start / block == (end - 1) / block;
+        bool sameMapping = op.outAddress - op.inAddress == write.outAddress - write.inAddress;
+        if (!touches || !sameBlock || !sameMapping) {
+            if (overlaps) {
+                return false;
+            }
+            continue;
+        }
+
+        // the newer write's bytes go over the older one's
+        OperationData merged;
+        merged.resize(end - start);
+        std::copy(op.data.begin(), op.data.end(), merged.begin() + (op.inAddress - start));
+        std::copy(write.data.begin(), write.data.end(), merged.begin() + (write.inAddress - start));
+
+        op.outAddress -= op.inAddress - start;
+        op.inAddress = start;
+        op.bytes = merged.size();
+        op.data = std::move(merged);
+        coalescedWrites++;
+        return true;
+    }
+    return false;
+}
+// Reads a load entirely from committed writes still waiting for the bus,
+// the newest one holding each byte winning.
+bool MemoryUnit::forwardStores(uint32_t address, int count, uint32_t asid, uint32_t &value) {
+    if (storeBufferDepth == 0 || !canCache(address, asid)) {
+        return false;
+    }
+
+    value = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        uint32_t byteAddress = address + i;
+        bool found = false;
+        for (int j = queuedCount - 1; j >= 0; j--) {
+            auto &op = queued(j);
+            if (op.type == MemoryOpDataWrite && op.committed && op.asid == asid && byteAddress - op.inAddress < op.data.size()) {
+                value = (value << 8) | op.data[byteAddress - op.inAddress];
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
 bool MemoryUnit::isOperationPrepared() {
     if (pendingOperation.isValid()) {
         return false;
     }
 
-    for (auto op: queuedOperations) {
-        if (op.committed) {
+    for (int i = 0; i < queuedCount; i++) {
+        if (queued(i).committed) {
             return true;
         }
     }
@@ -229,13 +639,51 @@ bool MemoryUnit::isOperationPrepared() {
     return false;
 }
 
-BusOperation MemoryUnit::getBusOperation() {
-    for (int i = queuedOperations.size() - 1; i >= 0; --i) {
-        if (queuedOperations[i].isReady()) {
-            auto op = queuedOperations[i];
+bool MemoryUnit::isOperationPending() {
+    uint32_t address;
+    return pendingOperation.isValid() || isOperationPrepared() || !levelTwoFills.empty() || findPrefetch(address);
+}
+
+bool MemoryUnit::prefetch() {
+    uint32_t address;
+    if (pendingOperation.isValid() || queuedCount > 0 || !levelTwoFills.empty() || !findPrefetch(address)) {
+        return false;
+    }
+    queueRead(InstructionRead, address, 2, fetchAsid, true);
+    prefetchesIssued++;
+    return true;
+}
+// The first line ahead of the fetch address the instruction cache lacks,
+// stopping at the page's end, at a line already on its way, or before
+// wrapping round to the fetch line's own set.
+bool MemoryUnit::findPrefetch(uint32_t &address) {
+    if (prefetchDepth == 0 || !caches.contains(InstructionCache) || !canCache(fetchAddress, fetchAsid)) {
+        return false;
+    }
 
+    auto &cache = caches[InstructionCache];
+    uint32_t line = fetchAddress & ~cache.getLineMask();
+    for (int i = 1; i <= prefetchDepth && i < cache.getSetCount(); i++) {
+        address = line + i * cache.getLineBytes();
+        uint32_t outAddress;
+        if ((address ^ fetchAddress) & 0xfffff000 || !canCache(address, fetchAsid) ||
+            !translateAddress(address, cache.getLineBytes(), fetchAsid, outAddress).isComplete()) {
+            return false;
+        }
+        if (cache.contains(address, 1, fetchAsid) != CacheContainsNone) {
+            continue;
+        }
+        return !isReadQueued(InstructionRead, address, fetchAsid);
+    }
+    return false;
+}
+
+BusOperation MemoryUnit::getBusOperation() {
+    for (int i = 0; i < queuedCount; i++) {
+        auto &op = queued(i);
+        if (op.isReady()) {
             if (op.type == MemoryOpDataWrite) {
-                applyWrite(op);
+                applyWrite(op, false);
             }
             else {
                 pendingOperation = op;
@@ -244,10 +692,7 @@ BusOperation MemoryUnit::getBusOperation() {
             BusOperation busOp = op.getBusOperation();
 
             if (!op.isValid()) {
-                queuedOperations.erase(std::next(queuedOperations.begin(), i));
-            }
-            else {
-                queuedOperations[i] = op;
+                removeQueued(i);
             }
             return busOp;
         }
@@ -256,13 +701,108 @@ BusOperation MemoryUnit::getBusOperation() {
     BusOperation busOp;
     return busOp;
 }
+bool MemoryUnit::takeWrite(BusOperation &busOp) {
+    for (int i = 0; i < queuedCount; i++) {
+        auto &op = queued(i);
+        if (op.type != MemoryOpDataWrite || !op.isReady()) {
+            continue;
+        }
+        applyWrite(op, false);
+        busOp = op.getBusOperation();
+
+        if (!op.isValid()) {
+            removeQueued(i);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Puts a write into the caches holding its addresses. On commit, the first
+// write-back level holding all of it takes it, dirtying its lines, and it
+// goes no further; returns whether that happened. Otherwise the copies are
+// only brought up to date, as the write is going out on the bus.
+bool MemoryUnit::applyWrite(const MemoryOperation &op, bool commit) {
+    if (!codePages.empty()) {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        translateAddress(op.inAddress, 1, op.asid, first);
+        translateAddress(op.inAddress + op.data.size() - 1, 1, op.asid, last);
+        if (codePages.contains(first >> 12) || codePages.contains(last >> 12)) {
+            codeChanged();
+        }
+    }
+
+    // an earlier write still to go out could overwrite a dirty line with
+    // older data, so this one follows it onto the bus
+    bool canAbsorb = commit && !isWriteQueued(op);
+    bool absorbed = false;
 
-void MemoryUnit::applyWrite(MemoryOperation op) {
     for (auto c: {InstructionCache, DataCache, UnifiedL2Cache}) {
-        if (caches.contains(c) && caches[c].contains(op.inAddress, op.data.size(), op.asid) != CacheContainsNone) {
-            caches[c].write(op.inAddress, op.asid, op.data);
+        if (!caches.contains(c) || absorbed) {
+            continue;
         }
+        auto &cache = caches[c];
+        auto held = cache.contains(op.inAddress, op.data.size(), op.asid);
+        if (held == CacheContainsNone) {
+            continue;
+        }
+
+        absorbed = canAbsorb && cache.isWriteBack() && (held == CacheContainsSingle || held == CacheContainsSplit);
+        cache.write(op.inAddress, op.asid, op.data, absorbed);
     }
+    if (absorbed) {
+        absorbedWrites++;
+    }
+
+    // lines on their way up from the L2 were read before this write
+    for (auto &fill: levelTwoFills) {
+        auto &line = fill.operation;
+        if (line.asid != op.asid) {
+            continue;
+        }
+        for (int i = 0; i < op.data.size(); i++) {
+            uint32_t offset = op.inAddress + i - line.inAddress;
+            if (offset < line.data.size()) {
+                line.data[offset] = op.data[i];
+            }
+        }
+    }
+    patchPending(op);
+
+    return absorbed;
+}
+
+// A read already on the bus returns what memory held before any write still
+// waiting behind it, so the bytes it brings back are brought up to date with
+// the committed ones.
+void MemoryUnit::patchPending(const MemoryOperation &write) {
+    auto &line = pendingOperation;
+    if (!line.isValid() || line.asid != write.asid) {
+        return;
+    }
+    for (int i = 0; i < write.data.size(); i++) {
+        uint32_t offset = write.inAddress + i - line.inAddress;
+        if (offset >= (uint32_t) line.bytes) {
+            continue;
+        }
+        size_t index = line.arrivalIndex(offset);
+        if (index < line.data.size()) {
+            line.data[index] = write.data[i];
+        }
+    }
+}
+bool MemoryUnit::isWriteQueued(const MemoryOperation &write) {
+    for (int i = 0; i < queuedCount; i++) {
+        auto &op = queued(i);
+        if (op.type != MemoryOpDataWrite || !op.committed || &op == &write) {
+            continue;
+        }
+        if (op.inAddress < write.inAddress + write.data.size() && write.inAddress < op.inAddress + op.data.size()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void MemoryUnit::ingestWord(uint16_t word) {
@@ -279,10 +819,20 @@ void MemoryUnit::ingestWord(uint16_t word) {
     pending.data.push_back(low);
     pending.data.push_back(high);
 
+    for (int i = 0; i < queuedCount; i++) {
+        auto &op = queued(i);
+        if (op.type == MemoryOpDataWrite && op.committed) {
+            patchPending(op);
+        }
+    }
+
     if (pending.data.size() == pending.bytes) {
+        if (pending.criticalByte > 0) {
+            std::rotate(pending.data.begin(), pending.data.end() - pending.criticalByte, pending.data.end());
+        }
         if (canCache(pending.inAddress, pending.asid)) {
             CacheType type = pending.type == MemoryOpInstructionRead ? InstructionCache : DataCache;
-            caches[type].load(pending.inAddress, pending.asid, 0, pending.data);
+            fillLine(type, pending.inAddress, pending.asid, pending.data, pending.prefetch);
         }
         else {
             lastUncachedRead = pending;
@@ -292,12 +842,239 @@ void MemoryUnit::ingestWord(uint16_t word) {
     }
 }
 
+void MemoryUnit::clockDown() {
+    for (auto iter = levelTwoFills.begin(); iter != levelTwoFills.end();) {
+        if (--iter->cycles > 0) {
+            iter++;
+            continue;
+        }
+        auto &line = iter->operation;
+        fillLevelOne(line.type == MemoryOpInstructionRead ? InstructionCache : DataCache, line.inAddress, line.asid, line.data, iter->dirty, line.prefetch);
+        releaseSlot(line.operationId & slotMask);
+        iter = levelTwoFills.erase(iter);
+    }
+}
+
+// A line read from the bus goes into the L1 that missed it and, unless the
+// L2 only takes what the L1s evict, into the L2.
+void MemoryUnit::fillLine(CacheType type, uint32_t address, uint32_t asid, std::span<const uint8_t> data, bool prefetched) {
+    if (!caches.contains(type)) {
+        return;
+    }
+    if (caches.contains(UnifiedL2Cache) && levelTwoInclusion != ExclusiveCache) {
+        fillLevelTwo(address, asid, data);
+    }
+    fillLevelOne(type, address, asid, data, false, prefetched);
+}
+void MemoryUnit::fillLevelOne(CacheType type, uint32_t address, uint32_t asid, std::span<const uint8_t> data, bool dirty, bool prefetched) {
+    auto &cache = caches[type];
+    auto way = cache.selectWay(address, asid);
+
+    uint32_t victimAddress;
+    uint32_t victimAsid;
+    if (cache.lineAt(way, victimAddress, victimAsid)) {
+        if (cache.getFlags(way) & CACHE_FLAG_PREFETCH) {
+            wastedPrefetches++;
+        }
+        bool victimDirty = cache.isDirty(way);
+        if (victimDirty || (levelTwoInclusion == ExclusiveCache && caches.contains(UnifiedL2Cache))) {
+            victimLine.resize(cache.getLineBytes());
+            cache.get(victimAddress, victimLine, victimAsid);
+            evictLevelOne(victimAddress, victimAsid, victimLine, victimDirty);
+        }
+    }
+
+    if (dirty && !cache.isWriteBack()) {
+        writeBack(address, asid, data);
+        dirty = false;
+    }
+    cache.load(address, asid, lineFlags(address, asid) | (dirty ? CACHE_FLAG_DIRTY : 0) | (prefetched ? CACHE_FLAG_PREFETCH : 0), way.way, data);
+}
+void MemoryUnit::fillLevelTwo(uint32_t address, uint32_t asid, std::span<const uint8_t> data, bool dirty) {
+    auto &levelTwo = caches[UnifiedL2Cache];
+    auto way = levelTwo.selectWay(address, asid);
+
+    uint32_t victimAddress;
+    uint32_t victimAsid;
+    if (levelTwo.lineAt(way, victimAddress, victimAsid)) {
+        // an inclusive L2 takes what it evicts out of the L1s as well, and a
+        // dirty L1 copy is newer than its own
+        bool written = false;
+        if (levelTwoInclusion == InclusiveCache) {
+            for (auto c: {InstructionCache, DataCache}) {
+                if (!caches.contains(c)) {
+                    continue;
+                }
+                if (!written && caches[c].isDirty(caches[c].lookup(victimAddress, victimAsid))) {
+                    writeBack(caches[c], victimAddress, victimAsid);
+                    written = true;
+                }
+                caches[c].flush(victimAddress, victimAsid);
+            }
+        }
+        if (!written && levelTwo.isDirty(way)) {
+            writeBack(levelTwo, victimAddress, victimAsid);
+        }
+    }
+
+    if (dirty && !levelTwo.isWriteBack()) {
+        writeBack(address, asid, data);
+        dirty = false;
+    }
+    levelTwo.load(address, asid, lineFlags(address, asid) | (dirty ? CACHE_FLAG_DIRTY : 0), way.way, data);
+}
+// A line leaving an L1 goes down into an L2 holding it or taking victims,
+// and to memory from there if it is dirty and the L2 won't keep it.
+void MemoryUnit::evictLevelOne(uint32_t address, uint32_t asid, std::span<const uint8_t> data, bool dirty) {
+    if (caches.contains(UnifiedL2Cache)) {
+        auto &levelTwo = caches[UnifiedL2Cache];
+        if (levelTwo.lookup(address, asid).isHit()) {
+            if (dirty) {
+                levelTwo.write(address, asid, data);
+                if (!levelTwo.isWriteBack()) {
+                    writeBack(address, asid, data);
+                }
+            }
+            return;
+        }
+        if (levelTwoInclusion == ExclusiveCache) {
+            fillLevelTwo(address, asid, data, dirty);
+            return;
+        }
+    }
+
+    if (dirty) {
+        writeBack(address, asid, data);
+    }
+}
+
+// Unmapped lines may be written; mapped ones carry what the TLB allows.
+uint8_t MemoryUnit::lineFlags(uint32_t address, uint32_t asid) {
+    if (getSegment(address) == MemorySegmentK0) {
+        return CACHE_FLAG_WRITE;
+    }
+    return tlb.getFlags(address, asid);
+}
+
+void MemoryUnit::writeBack(uint32_t address, uint32_t asid, std::span<const uint8_t> data) {
+    MemoryOperation operation;
+    operation.inAddress = address;
+    translateAddress(address, data.size(), asid, operation.outAddress);
+    operation.asid      = asid;
+    operation.bytes     = data.size();
+    operation.data.assign(data.begin(), data.end());
+    operation.type      = MemoryOpDataWrite;
+    operation.committed = true;
+
+    // evictions can't wait for room in the queue
+    pushOperation(operation, false);
+    writeBacks++;
+}
+void MemoryUnit::writeBack(ConfiguredCache<uint32_t, uint8_t, uint32_t, uint8_t> &cache, uint32_t address, uint32_t asid) {
+    OperationData data;
+    data.resize(cache.getLineBytes());
+    cache.get(address, data, asid);
+    writeBack(address, asid, data);
+}
+
+// Dirty lines of mapped addresses are written back while the TLB can still
+// translate them.
+void MemoryUnit::cleanMappedLines() {
+    for (auto &[type, cache]: caches) {
+        if (!cache.isWriteBack()) {
+            continue;
+        }
+        for (int set = 0; set < cache.getSetCount(); set++) {
+            for (int way = 0; way < cache.getWayCount(); way++) {
+                CacheWay line{set, way};
+                uint32_t address;
+                uint32_t asid;
+                if (cache.isDirty(line) && cache.lineAt(line, address, asid) && getSegment(address) != MemorySegmentK0) {
+                    writeBack(cache, address, asid);
+                    cache.clean(line);
+                }
+            }
+        }
+    }
+}
+
+void MemoryUnit::flushCaches(bool invalidate) {
+    for (auto &[type, cache]: caches) {
+        for (int set = 0; set < cache.getSetCount(); set++) {
+            for (int way = 0; way < cache.getWayCount(); way++) {
+                CacheWay line{set, way};
+                uint32_t address;
+                uint32_t asid;
+                if (cache.isDirty(line) && cache.lineAt(line, address, asid)) {
+                    writeBack(cache, address, asid);
+                    cache.clean(line);
+                }
+            }
+        }
+        if (invalidate) {
+            cache.flush();
+        }
+    }
+}
+
+std::string MemoryUnit::describeLevelTwo() {
+    std::stringstream response;
+    if (!caches.contains(UnifiedL2Cache)) {
+        response << "l2 cache off" << std::endl;
+        return response.str();
+    }
+
+    const char *inclusion = levelTwoInclusion == InclusiveCache ? "inclusive" : levelTwoInclusion == ExclusiveCache ? "exclusive" : "nine";
+    response << std::dec << "l2 cache " << inclusion << ", latency: " << levelTwoLatency;
+    response << ", hits: " << levelTwoHits << ", misses: " << levelTwoMisses << std::endl;
+    return response.str();
+}
+
+std::string MemoryUnit::describeWriteBack() {
+    std::stringstream response;
+    response << std::dec << "write-back: stores absorbed: " << absorbedWrites << ", lines written back: " << writeBacks << std::endl;
+    return response.str();
+}
+
+std::string MemoryUnit::describeStoreBuffer() {
+    std::stringstream response;
+    if (storeBufferDepth == 0) {
+        response << "store buffer off" << std::endl;
+        return response.str();
+    }
+    response << std::dec << "store buffer depth: " << storeBufferDepth << ", stores merged: " << coalescedWrites;
+    response << ", loads forwarded: " << forwardedLoads << std::endl;
+    return response.str();
+}
+
+std::string MemoryUnit::describePrefetch() {
+    std::stringstream response;
+    if (prefetchDepth == 0) {
+        response << "prefetch off" << std::endl;
+        return response.str();
+    }
+    response << std::dec << "prefetch depth: " << prefetchDepth << ", issued: " << prefetchesIssued;
+    response << ", useful: " << usefulPrefetches << ", wasted: " << wastedPrefetches << std::endl;
+    return response.str();
+}
+
+std::string MemoryUnit::describeCriticalWord() {
+    std::stringstream response;
+    if (!criticalWordFirst) {
+        response << "critical word first off" << std::endl;
+        return response.str();
+    }
+    response << std::dec << "critical word first, early restarts: " << earlyRestarts << std::endl;
+    return response.str();
+}
+
 std::string MemoryUnit::describeQueuedOperations() {
     std::stringstream response;
 
     response << "C  VADDR     PADDR   T B   BYTES";
 
-    for (auto iter = queuedOperations.cbegin(); iter != queuedOperations.cend(); iter++) {
+    for (int i = queuedCount - 1; i >= 0; i--) {
+        auto iter = &queued(i);
         //if (!(iter->isValid())) {
             //continue;
         //}
@@ -317,7 +1094,7 @@ std::string MemoryUnit::describeQueuedOperations() {
         response << std::setw(8) << std::setfill('0') << std::hex << iter->inAddress << "  " << std::setw(6) << iter->outAddress << "  ";
         response << operType << " " << std::setw(2) << std::dec << iter->bytes << " ";
 
-        for (auto it = iter->data.cbegin(); it != iter->data.cend(); it++) {
+        for (auto it = iter->data.begin(); it != iter->data.end(); it++) {
             response << " " << std::setw(2) << std::setfill('0') << std::hex << (int)(*it);
         }
     }
@@ -339,7 +1116,7 @@ std::string MemoryUnit::describeQueuedOperations() {
         response << std::setw(8) << std::setfill('0') << std::hex << pendingOperation.inAddress << "  " << std::setw(6) << pendingOperation.outAddress << "  ";
         response << operType << " " << std::setw(2) << std::dec << pendingOperation.bytes << " ";
 
-        for (auto it = pendingOperation.data.cbegin(); it != pendingOperation.data.cend(); it++) {
+        for (auto it = pendingOperation.data.begin(); it != pendingOperation.data.end(); it++) {
             response << " " << std::setw(2) << std::setfill('0') << std::hex << (int) (*it);
         }
     }
@@ -437,8 +1214,7 @@ MemoryCheck MemoryUnit::translateAddress(uint32_t address, int count, uint32_t a
         return MemoryCheckNoPresent;
     }
 
-    auto tlbContent = tlb.get(address, 1, asid, updateLru);
-    uint32_t upperAddress = tlbContent[0];
+    uint32_t upperAddress = tlb.readValue(address, 1, asid, updateLru);
 
     outAddress = (upperAddress << 12) | (address & 0xfff);
 
@@ -476,21 +1252,55 @@ bool MemoryUnit::isKernelSegment(uint32_t address) {
 }
 
 void MemoryUnit::loadTlb(uint32_t virtualAddress, uint16_t physicalAddress, uint16_t flags, uint32_t asid) {
-    std::vector<uint16_t> value(1);
-    value[0] = physicalAddress;
-
-    tlb.load(virtualAddress, asid, flags, value);
+    cleanMappedLines();
+    tlb.load(virtualAddress, asid, flags, {&physicalAddress, 1});
+    codeChanged();
 }
 void MemoryUnit::expireTlb(uint32_t virtualAddress, uint32_t asid) {
+    cleanMappedLines();
     tlb.flush(virtualAddress, asid);
+    codeChanged();
 }
 void MemoryUnit::flushTlb() {
+    cleanMappedLines();
     tlb.flush();
+    codeChanged();
+}
+
+// Reads an instruction word the way a fetch hitting the instruction cache
+// would, without touching the cache's replacement state. Fails for anything
+// a fetch would have to wait for or fault on.
+bool MemoryUnit::peekInstruction(uint32_t address, uint16_t &word) {
+    if (!canCache(address, 0) || !caches.contains(InstructionCache)) {
+        return false;
+    }
+    if (check(MemoryOpInstructionRead, address, 2, 0).result != MemoryCheckContainsSingle) {
+        return false;
+    }
+    if (caches[InstructionCache].contains(address, 2, 0) != CacheContainsSingle) {
+        return false;
+    }
+
+    word = caches[InstructionCache].readValue(address, 2, 0, false);
+    return true;
+}
+void MemoryUnit::watchCodePage(uint32_t address) {
+    uint32_t physicalAddress = 0;
+    translateAddress(address, 1, 0, physicalAddress);
+    codePages.insert(physicalAddress >> 12);
+}
+void MemoryUnit::clearCodePages() {
+    codePages.clear();
+}
+void MemoryUnit::codeChanged() {
+    codePages.clear();
+    codeGeneration++;
 }
 
 uint16_t MemoryUnit::isReadQueued(MemoryReadType type, uint32_t address, uint32_t asid) {
     MemoryOpType opType = type == InstructionRead ? MemoryOpInstructionRead : MemoryOpDataRead;
-    for (auto op: queuedOperations) {
+    for (int i = queuedCount - 1; i >= 0; i--) {
+        auto &op = queued(i);
         if (op.type != opType || op.asid != asid) {
             continue;
         }
@@ -499,6 +1309,13 @@ uint16_t MemoryUnit::isReadQueued(MemoryReadType type, uint32_t address, uint32_
         }
     }
 
+    for (auto &fill: levelTwoFills) {
+        auto &op = fill.operation;
+        if (op.type == opType && op.asid == asid && op.inAddress <= address && (op.inAddress + op.bytes) > address) {
+            return op.operationId;
+        }
+    }
+
     if (pendingOperation.type == opType &&
         pendingOperation.asid == asid &&
         pendingOperation.inAddress <= address &&
@@ -542,7 +1359,7 @@ BusOperation MemoryOperation::getBusOperation() {
 
             if (op.bytes == 2) {
                 if (hasData) {
-                    data.erase(data.begin());
+                    data.dropFront();
                     word |= ((uint16_t) data.front()) << 8;
                 }
                 outAddress += 2;
@@ -551,13 +1368,19 @@ BusOperation MemoryOperation::getBusOperation() {
         bytes -= op.bytes;
 
         if (hasData) {
-            data.erase(data.begin());
+            // the rest of the write stays at the addresses it still covers
+            inAddress += op.bytes;
+            data.dropFront();
             op.data.push_back(word);
         }
     }
     else {
         // we're aligned and a multiple of 2.
         // just word-ify it, and send it on its way
+        if (criticalByte >= 0) {
+            op.address += criticalByte;
+            op.wrapBytes = bytes;
+        }
         if (hasData) {
             for (int i = 0; i < data.size(); i += 2) {
                 word = data[i];
@@ -572,15 +1395,32 @@ BusOperation MemoryOperation::getBusOperation() {
     return op;
 }
 
+// Whether the bytes asked for have already arrived for a line being read
+// critical word first.
 CacheCheck MemoryOperation::contains(CacheType _type, uint32_t _address, int _count, uint32_t _asid) {
-    if (isValid() && _asid == asid) {
-        if (_type == InstructionCache && type == MemoryOpInstructionRead) {
-        }
-        else if (_type == DataCache && type == MemoryOpDataRead) {
-            
+    if (!isValid() || _asid != asid || criticalByte < 0) {
+        return CacheContainsNone;
+    }
+    if (!(_type == InstructionCache && type == MemoryOpInstructionRead) && !(_type == DataCache && type == MemoryOpDataRead)) {
+        return CacheContainsNone;
+    }
+    if (_address < inAddress || _address + _count > inAddress + bytes) {
+        return CacheContainsNone;
+    }
+    for (int i = 0; i < _count; i++) {
+        if ((size_t) arrivalIndex(_address + i - inAddress) >= data.size()) {
+            return CacheContainsNone;
         }
     }
-    return CacheContainsNone;
+    return CacheContainsSingle;
+}
+
+uint32_t MemoryOperation::readValue(uint32_t _address, int _count) {
+    uint32_t value = 0;
+    for (int i = _count - 1; i >= 0; i--) {
+        value = (value << 8) | data[arrivalIndex(_address + i - inAddress)];
+    }
+    return value;
 }
 
 MemoryCheck::MemoryCheck(CacheCheck check) {
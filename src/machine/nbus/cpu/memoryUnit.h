@@ -2,8 +2,14 @@
 #define SYSNP_MEMORYUNIT_H
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
+#include <initializer_list>
+#include <algorithm>
+#include <iterator>
 #include <set>
+#include <string>
+#include <stdexcept>
 #include "busunit.h"
 #include "cache.h"
 
@@ -19,6 +25,7 @@ namespace n16r {
 #define CACHE_FLAG_WRITE  0x08
 #define CACHE_FLAG_NOREAD 0x10
 #define CACHE_FLAG_USER   0x20
+#define CACHE_FLAG_PREFETCH 0x40
 
 enum CacheType {
     InstructionCache,
@@ -26,6 +33,21 @@ enum CacheType {
     UnifiedL2Cache
 };
 
+// What the L2 holds relative to the first level caches: everything they do,
+// whatever it was filled with, or only the lines they have given up.
+enum CacheInclusion {
+    InclusiveCache,
+    NonInclusiveCache,
+    ExclusiveCache
+};
+
+inline CacheInclusion parseCacheInclusion(const std::string &name) {
+    if (name == "inclusive") return InclusiveCache;
+    if (name == "nine"     ) return NonInclusiveCache;
+    if (name == "exclusive") return ExclusiveCache;
+    throw std::invalid_argument("Unknown cache inclusion policy \"" + name + "\"");
+}
+
 enum MemorySegment {
     MemorySegmentU0,
     MemorySegmentK0,
@@ -39,6 +61,12 @@ enum CacheMode {
     WriteBackCache
 };
 
+inline CacheMode parseCacheMode(const std::string &name) {
+    if (name == "writethrough") return WriteThroughCache;
+    if (name == "writeback"   ) return WriteBackCache;
+    throw std::invalid_argument("Unknown cache mode \"" + name + "\"");
+}
+
 enum MemoryReadType {
     InstructionRead,
     DataRead
@@ -76,18 +104,97 @@ struct MemoryCheck {
     bool isMiss() { return result < MemoryCheckContainsSingle; }
 };
 
+// The bytes of a memory operation, held inline up to inlineBytes so that
+// only operations on longer lines touch the heap.
+class OperationData {
+    public:
+        OperationData() {}
+        OperationData(std::initializer_list<uint8_t> values) { assign(values.begin(), values.end()); }
+
+        const static size_t inlineBytes = 64;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        uint8_t *data() { return storage() + first; }
+        const uint8_t *data() const { return storage() + first; }
+        uint8_t *begin() { return data(); }
+        uint8_t *end() { return data() + count; }
+        const uint8_t *begin() const { return data(); }
+        const uint8_t *end() const { return data() + count; }
+        uint8_t &operator[](size_t index) { return data()[index]; }
+        const uint8_t &operator[](size_t index) const { return data()[index]; }
+        uint8_t front() const { return data()[0]; }
+
+        void clear() {
+            first = 0;
+            count = 0;
+        }
+        void push_back(uint8_t value) {
+            reserve(count + 1);
+            data()[count++] = value;
+        }
+        void resize(size_t size) {
+            reserve(size);
+            if (size > count) {
+                std::memset(data() + count, 0, size - count);
+            }
+            count = size;
+        }
+        template<typename I>
+        void assign(I from, I to) {
+            clear();
+            resize(std::distance(from, to));
+            std::copy(from, to, begin());
+        }
+        // the rest stays where it is
+        void dropFront(size_t bytes = 1) {
+            first += bytes;
+            count -= bytes;
+        }
+
+        void saveState(SnapshotWriter&) const;
+        void loadState(SnapshotReader&);
+    private:
+        uint8_t local[inlineBytes] = {};
+        std::vector<uint8_t> spill;
+        uint32_t first = 0;
+        uint32_t count = 0;
+
+        uint8_t *storage() { return spill.empty() ? local : spill.data(); }
+        const uint8_t *storage() const { return spill.empty() ? local : spill.data(); }
+        size_t capacity() const { return spill.empty() ? inlineBytes : spill.size(); }
+        void reserve(size_t size) {
+            if (first + size <= capacity()) {
+                return;
+            }
+            if (size <= capacity()) {
+                std::memmove(storage(), data(), count);
+                first = 0;
+                return;
+            }
+            std::vector<uint8_t> grown(std::max(size, capacity() * 2));
+            std::copy(begin(), end(), grown.begin());
+            spill = std::move(grown);
+            first = 0;
+        }
+};
+
 struct MemoryOperation {
-    uint16_t operationId;
+    uint16_t operationId = invalidOperationId;
 
     uint32_t inAddress;
     uint32_t outAddress;
     uint32_t asid;
-    std::vector<uint8_t> data;
+    OperationData data;
     int bytes = 0;
 
     MemoryOpType type;
 
     bool committed = false;
+    bool prefetch = false;
+    // line reads: the offset of the word read first, the rest of the line
+    // following it round, or -1 to read the line in order
+    int criticalByte = -1;
 
     bool isValid() { return bytes > 0; }
     bool isReady() { return bytes > 1 && committed; }
@@ -95,6 +202,12 @@ struct MemoryOperation {
 
     BusOperation getBusOperation();
     CacheCheck contains(CacheType, uint32_t, int, uint32_t);
+    uint32_t readValue(uint32_t, int);
+    // where the byte at an offset into a read lands in data, as it arrives
+    int arrivalIndex(int offset) { return criticalByte > 0 ? (offset - criticalByte + bytes) % bytes : offset; }
+
+    void saveState(SnapshotWriter&);
+    void loadState(SnapshotReader&);
 
     const static uint16_t invalidOperationId = 0xffff;
 };
@@ -104,21 +217,34 @@ class MemoryUnit {
         MemoryUnit();
         ~MemoryUnit() {}
 
-        void setCache(CacheType, int, int, int, int);
+        void setCache(CacheType, int, int, int, int, ReplacementPolicy = ReplaceLru, CacheMode = WriteThroughCache);
+        void setLevelTwo(int, CacheInclusion);
+        void setStoreBuffer(int);
+        void setPrefetch(int);
+        void setCriticalWordFirst(bool);
         void addNoCacheRegion(uint32_t, uint32_t);
 
         MemoryCheck check(MemoryOpType, uint32_t, int, uint32_t);
         uint32_t read(CacheType, uint32_t, int, uint32_t);
 
-        uint16_t queueRead(MemoryReadType, uint32_t, int, uint32_t);
+        uint16_t queueRead(MemoryReadType, uint32_t, int, uint32_t, bool prefetch = false);
 
         uint16_t queueOperation     (MemoryOperation);
         void     commitOperation    (uint16_t);
         void     invalidateOperation(uint16_t);
 
         bool isOperationPrepared();
+        bool isOperationPending();
+        bool isLevelTwoFilling() { return !levelTwoFills.empty(); }
         BusOperation getBusOperation();
+        // the next piece of the oldest committed write, taken off the queue
+        // to go past the bus; returns whether there was one
+        bool takeWrite(BusOperation&);
+        // with nothing else to do, reads in a line the instruction stream
+        // is heading for; returns whether it did
+        bool prefetch();
         void ingestWord(uint16_t);
+        void clockDown();
 
         MemorySegment checkSegment(uint32_t, int);
         MemorySegment getSegment(uint32_t);
@@ -128,27 +254,133 @@ class MemoryUnit {
         void expireTlb(uint32_t, uint32_t);
         void flushTlb ();
 
+        // Code the CPU has translated. Writing to a watched page or changing
+        // the TLB moves the code generation on and forgets the watched pages.
+        bool peekInstruction(uint32_t, uint16_t&);
+        void watchCodePage(uint32_t);
+        void clearCodePages();
+        uint32_t getCodeGeneration() { return codeGeneration; }
+
+        // writes every dirty line back, optionally dropping every line too
+        void flushCaches(bool);
+
+        std::string describeLevelTwo();
+        std::string describeWriteBack();
+        std::string describeStoreBuffer();
+        std::string describePrefetch();
+        std::string describeCriticalWord();
         std::string describeQueuedOperations();
         std::string listContents(std::stringstream &);
+
+        void saveState(SnapshotWriter&);
+        void loadState(SnapshotReader&);
+        void saveGeometry(SnapshotWriter&);
     private:
-        std::vector<MemoryOperation> queuedOperations;
+        // Queued operations stay in the slot they were given while a ring
+        // of slot numbers keeps them in order, oldest first, and each slot
+        // keeps its place in the ring. The pipeline's operations and L2
+        // fills take one of a fixed few tagged slots: an operation ID is its
+        // slot in the low slotBits and the slot's generation above, so an
+        // operation is found without a search, and an ID kept after its
+        // operation is gone finds nothing. Write-backs need no ID and take
+        // the slots past those; they and the ring grow by doubling, since
+        // evictions can't wait for room in the queue.
+        const static int slotBits = 6;
+        const static uint16_t slotMask = (1 << slotBits) - 1;
+        const static int taggedSlots = 1 << slotBits;
+        std::vector<MemoryOperation> slots;
+        std::vector<uint16_t> freeSlots;
+        std::vector<uint16_t> freeWriteBackSlots;
+        std::vector<uint16_t> ring;
+        std::vector<uint16_t> ringPositions;
+        int ringHead;
+        int queuedCount;
+
+        MemoryOperation &queued(int index) { return slots[ring[(ringHead + index) & (ring.size() - 1)]]; }
+        MemoryOperation *findOperation(uint16_t);
+        int allocateSlot(bool);
+        void releaseSlot(uint16_t);
+        uint16_t pushOperation(const MemoryOperation&, bool);
+        void placeQueued(int, uint16_t);
+        void removeQueued(int);
+        int queuedIndex(uint16_t);
+        void rebuildFreeSlots();
+
         MemoryOperation pendingOperation;
         MemoryOperation lastUncachedRead;
 
-        std::map<CacheType, Cache<uint32_t, uint8_t, uint32_t, uint8_t>> caches;
+        std::map<CacheType, ConfiguredCache<uint32_t, uint8_t, uint32_t, uint8_t>> caches;
         Cache<uint32_t, uint16_t, uint32_t, uint16_t> tlb;
 
+        // L1 misses the L2 holds reach the L1 after levelTwoLatency cycles
+        // instead of going out on the bus. Each keeps an empty slot for its ID.
+        struct LevelTwoFill {
+            MemoryOperation operation;
+            int cycles;
+            bool dirty;
+        };
+        std::vector<LevelTwoFill> levelTwoFills;
+        int levelTwoLatency;
+        CacheInclusion levelTwoInclusion;
+        uint64_t levelTwoHits;
+        uint64_t levelTwoMisses;
+        OperationData victimLine;
+        void fillLine(CacheType, uint32_t, uint32_t, std::span<const uint8_t>, bool prefetched = false);
+        void fillLevelOne(CacheType, uint32_t, uint32_t, std::span<const uint8_t>, bool dirty = false, bool prefetched = false);
+        void fillLevelTwo(uint32_t, uint32_t, std::span<const uint8_t>, bool dirty = false);
+        void evictLevelOne(uint32_t, uint32_t, std::span<const uint8_t>, bool);
+        uint8_t lineFlags(uint32_t, uint32_t);
+
+        // write-back caches: stores they took instead of the bus, and dirty
+        // lines written out
+        uint64_t absorbedWrites;
+        uint64_t writeBacks;
+        void writeBack(uint32_t, uint32_t, std::span<const uint8_t>);
+        void writeBack(ConfiguredCache<uint32_t, uint8_t, uint32_t, uint8_t>&, uint32_t, uint32_t);
+        void cleanMappedLines();
+
+        // with a store buffer, up to storeBufferDepth writes wait for the
+        // bus, committed ones to cacheable memory merging into the block of
+        // an older one, and loads they cover read from them
+        int storeBufferDepth;
+        uint64_t coalescedWrites;
+        uint64_t forwardedLoads;
+        bool coalesceWrite(int);
+        bool forwardStores(uint32_t, int, uint32_t, uint32_t&);
+
+        // the next prefetchDepth lines after the one being fetched from,
+        // within its page, are read into the instruction cache while the
+        // bus is free. Prefetched lines are useful once fetched from and
+        // wasted if evicted first.
+        int prefetchDepth;
+        uint32_t fetchAddress;
+        uint32_t fetchAsid;
+        uint64_t prefetchesIssued;
+        uint64_t usefulPrefetches;
+        uint64_t wastedPrefetches;
+        bool findPrefetch(uint32_t&);
+
+        // line reads start from the word that missed, and it is read from
+        // the line while the rest of it is still arriving
+        bool criticalWordFirst;
+        uint64_t earlyRestarts;
+
         std::vector<std::pair<uint32_t, uint32_t>> noCacheRegions;
 
+        std::set<uint32_t> codePages;
+        uint32_t codeGeneration;
+        void codeChanged();
+
         bool canCache(uint32_t, uint32_t);
 
         uint16_t isReadQueued(MemoryReadType, uint32_t, uint32_t);
 
-        void applyWrite(MemoryOperation);
+        bool applyWrite(const MemoryOperation&, bool);
+        void patchPending(const MemoryOperation&);
+        bool isWriteQueued(const MemoryOperation&);
 
         MemoryCheck translateAddress(uint32_t, int, uint32_t, uint32_t&, bool u=false);
 
-        uint32_t convert(std::vector<uint8_t>);
 };
 
 }; // namespace n16r
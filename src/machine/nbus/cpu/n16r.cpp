@@ -1,6 +1,8 @@
 #include "n16r.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <bit>
 
 namespace sysnp {
 
@@ -29,14 +31,52 @@ uint32_t e16s32(uint16_t in) {
 }
 
 void N16R::init(ryml::NodeRef &setting) {
-    isPipelined = false;
     setting["resetAddress"] >> resetAddress;
-    setting["pipelined"   ] >> isPipelined;
+
+    isPipelined = true;
+    if (setting.has_child("pipelined")) {
+        setting["pipelined"] >> isPipelined;
+    }
+
+    useDecodeCache = true;
+    if (setting.has_child("decodeCache")) {
+        setting["decodeCache"] >> useDecodeCache;
+    }
+    decodeCache.assign(useDecodeCache ? (1 << decodeCacheBits) : 0, DecodedInstruction());
+    decodeCacheHits = 0;
+    decodeCacheMisses = 0;
+
+    useTranslation = false;
+    if (setting.has_child("translate")) {
+        setting["translate"] >> useTranslation;
+    }
 
     auto cacheConfig    = setting["cache"];
     auto cachesConfig   = cacheConfig["caches"];
     auto noCachesConfig = cacheConfig["noCache"];
 
+    if (cacheConfig.has_child("storeBuffer")) {
+        int storeBuffer = 0;
+        cacheConfig["storeBuffer"] >> storeBuffer;
+        memoryUnit.setStoreBuffer(storeBuffer);
+    }
+
+    bool prefetch = false;
+    int prefetchDepth = 1;
+    if (cacheConfig.has_child("prefetch")) {
+        cacheConfig["prefetch"] >> prefetch;
+    }
+    if (cacheConfig.has_child("prefetchDepth")) {
+        cacheConfig["prefetchDepth"] >> prefetchDepth;
+    }
+    memoryUnit.setPrefetch(prefetch ? prefetchDepth : 0);
+
+    if (cacheConfig.has_child("criticalWordFirst")) {
+        bool criticalWordFirst = false;
+        cacheConfig["criticalWordFirst"] >> criticalWordFirst;
+        memoryUnit.setCriticalWordFirst(criticalWordFirst);
+    }
+
     int regionCount = noCachesConfig.num_children();
     for (int i = 0; i < regionCount; i++) {
         auto regionConfig = noCachesConfig[i];
@@ -58,18 +98,46 @@ void N16R::init(ryml::NodeRef &setting) {
         int binBits = 0;
         int lineBits = 0;
         int ways = 0;
+        std::string replacement = "lru";
+        std::string mode = "writethrough";
 
         cacheConfig["type"    ] >> type;
         cacheConfig["binBits" ] >> binBits;
         cacheConfig["lineBits"] >> lineBits;
         cacheConfig["ways"    ] >> ways;
+        if (cacheConfig.has_child("replacement")) {
+            cacheConfig["replacement"] >> replacement;
+        }
+        if (cacheConfig.has_child("mode")) {
+            cacheConfig["mode"] >> mode;
+        }
+
+        CacheType cacheType = InstructionCache;
+        if (type == "data") {
+            cacheType = DataCache;
+        }
+        else if (type == "l2") {
+            cacheType = UnifiedL2Cache;
+
+            int latency = 4;
+            std::string inclusion = "inclusive";
+            if (cacheConfig.has_child("latency")) {
+                cacheConfig["latency"] >> latency;
+            }
+            if (cacheConfig.has_child("inclusion")) {
+                cacheConfig["inclusion"] >> inclusion;
+            }
+            memoryUnit.setLevelTwo(latency, parseCacheInclusion(inclusion));
+        }
 
         memoryUnit.setCache(
-            type == "data" ? DataCache : InstructionCache,
+            cacheType,
             32, // address bits
             binBits,
             lineBits,
-            ways
+            ways,
+            parseReplacementPolicy(replacement),
+            parseCacheMode(mode)
         );
     }
 
@@ -84,25 +152,37 @@ void N16R::postInit() {
 
     lastBreakpoint = 0;
     breakpointWasHit = false;
+    watchpointWasHit = false;
+    breakpointDrain = false;
 
     retiredAddresses.set_capacity(512);
 }
 
 void N16R::clockUp() {
-    machine->debug("N16R::clockUp()");
+    SYSNP_DEBUG(machine, 3, "N16R::clockUp()");
 
-    writeBackStage();
-    memoryStage();
-    executeStage();
-    decodeStage();
-    fetchStage();
+    watchpointWasHit = false;
+    bool stepping = owedCycles == 0;
+    if (isPipelined && stepping) {
+        writeBackStage();
+        memoryStage();
+        executeStage();
+        decodeStage();
+        fetchStage();
+    }
+    else if (stepping) {
+        functionalStep();
+    }
 
     // Bus interface
-    machine->debug("Processing bus unit");
+    SYSNP_DEBUG(machine, 3, "Processing bus unit");
 
     if (busUnit.isIdle()) {
+        if (stepping) {
+            memoryUnit.prefetch();
+        }
         if (memoryUnit.isOperationPrepared()) {
-            machine->debug("Queueing operation");
+            SYSNP_DEBUG(machine, 3, "Queueing operation");
             busUnit.queueOperation(memoryUnit.getBusOperation());
         }
     }
@@ -110,18 +190,25 @@ void N16R::clockUp() {
 }
 
 void N16R::clockDown() {
-    machine->debug("N16R::clockDown()");
-
-    machine->debug("Shifting stages");
-    stageShift();
-    stageClearOut();
+    SYSNP_DEBUG(machine, 3, "N16R::clockDown()");
 
-    clockCount++;
+    // the cycles a translated run owes were counted when it ran
+    if (owedCycles > 0) {
+        owedCycles--;
+    }
+    else {
+        if (isPipelined) {
+            SYSNP_DEBUG(machine, 3, "Shifting stages");
+            stageShift();
+        }
+        clockCount++;
+    }
 
-    machine->debug("Processing bus unit");
+    SYSNP_DEBUG(machine, 3, "Processing bus unit");
     busUnit.clockDown();
+    memoryUnit.clockDown();
 
-    if (busUnit.hasData()) {
+    while (busUnit.hasData()) {
         memoryUnit.ingestWord(busUnit.getWord());
     }
 
@@ -132,21 +219,548 @@ void N16R::clockDown() {
     registerFile[causeRegister] = (registerFile[causeRegister] & 0xff) | pendingInterrupts;
 }
 
+uint64_t N16R::nextEvent() {
+    bool memoryIdle = busUnit.isIdle() && !busUnit.hasData() && !memoryUnit.isOperationPending();
+
+    // the cycles a translated run owes can go by at once when nothing else
+    // of the core's is moving
+    if (owedCycles > 0) {
+        return memoryIdle ? owedCycles : 0;
+    }
+
+    // A core waiting only on an instruction fetch goes through the same
+    // cycle until the bus unit has the words. Other waits still step.
+    if (!halted && isWaitingOnFetch()) {
+        return busUnit.quietCycles();
+    }
+
+    // While halted, the pipeline keeps re-issuing the halted address until
+    // an interrupt arrives. Once it has settled and nothing is in flight on
+    // the bus, every cycle looks the same and can be skipped.
+    if (!halted || hasInterrupts() || (isPipelined && !isPipelineSettled())) {
+        return 0;
+    }
+    if (!memoryIdle) {
+        return 0;
+    }
+    return UINT64_MAX;
+}
+
+void N16R::skipCycles(uint64_t cycles) {
+    uint64_t owed = std::min(cycles, owedCycles);
+    owedCycles -= owed;
+
+    // a halted or waiting core retires nothing
+    clockCount += cycles - owed;
+    busUnit.skipCycles(cycles);
+}
+
+// Hands the committed writes waiting in the memory unit straight to the
+// devices they address, so that memory shows what a flush wrote back without
+// clocking the machine. A write already on the bus finishes there.
+void N16R::drainMemory() {
+    BusOperation write;
+    while (memoryUnit.takeWrite(write)) {
+        busUnit.writeThrough(write);
+    }
+}
+
+bool N16R::isPipelineDrained() {
+    for (int i = 1; i < pipelineDepth; i++) {
+        if (!stageAt(i).bubble) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only the fetch is left, held up on a read no breakpoint or L2 fill can
+// disturb.
+bool N16R::isWaitingOnFetch() {
+    if (hasInterrupts() || breakpointDrain || memoryUnit.isLevelTwoFilling()) {
+        return false;
+    }
+    auto &fetch = stageAt(0);
+    if (fetch.bubble || !fetch.delayed || fetch.exception || breakpoints.contains(fetch.instructionPointer)) {
+        return false;
+    }
+    if (!isPipelined) {
+        return functionalStage == 0;
+    }
+    return isPipelineDrained();
+}
+
+bool N16R::isPipelineSettled() {
+    uint32_t address = stageAt(0).instructionPointer;
+    for (auto &stage: stageRing) {
+        if (stage.bubble || stage.delayed || stage.exception || stage.taken) {
+            return false;
+        }
+        // only re-issued fetches that were never decoded
+        if (stage.instructionPointer != address || stage.nextInstructionPointer != address) {
+            return false;
+        }
+        if (stage.executeOp != ExecuteNop || stage.memoryOp != MemoryNop || stage.commitOp != CommitNop) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Without the pipeline, a single instruction goes through the same stage
+// logic from fetch to write back. Everything that can complete does so within
+// one clock; a stage waiting on memory picks up again on the next one. Each
+// flush the pipeline would have taken is charged as a fixed cycle cost.
+void N16R::functionalStep() {
+    if (halted) {
+        if (!hasInterrupts()) {
+            return;
+        }
+        // the interrupt is taken on the instruction following the halt
+        functionalAdvance(4);
+    }
+    else if (useTranslation && functionalStage == 0 && !stageAt(0).delayed && runTranslated() > 0) {
+        return;
+    }
+
+    while (true) {
+        switch (functionalStage) {
+            case 0:
+                fetchStage();
+                break;
+            case 1:
+                decodeStage();
+                break;
+            case 2:
+                executeStage();
+                break;
+            case 3:
+                memoryStage();
+                break;
+            default:
+                writeBackStage();
+                break;
+        }
+
+        if (stageAt(functionalStage).delayed) {
+            return;
+        }
+        if (functionalStage == 4) {
+            break;
+        }
+
+        functionalAdvance(functionalStage + 1);
+
+        // stop in front of a breakpoint the way the pipeline does
+        if (functionalStage == 1 && breakpointWasHit) {
+            return;
+        }
+    }
+
+    functionalRetire();
+}
+
+void N16R::functionalAdvance(int to) {
+    stageAt(to) = stageAt(functionalStage);
+    stageAt(functionalStage) = StageRegister();
+    functionalStage = to;
+}
+
+void N16R::functionalRetire() {
+    auto &retired = stageAt(4);
+
+    retiredAddresses.push_back(retired.instructionPointer);
+    retiredCount++;
+
+    bool redirected = retired.exception || retired.taken;
+    if (redirected || retired.commitOp == CommitLoadTlb || retired.commitOp == CommitExpireTlb || retired.commitOp == CommitFlushTlb) {
+        clockCount += functionalFlushCost;
+    }
+
+    StageRegister nextStart;
+    nextStart.instructionPointer = redirected ? retired.altInstructionPointer : retired.nextInstructionPointer;
+    nextStart.nextInstructionPointer = nextStart.instructionPointer;
+    nextStart.altInstructionPointer  = 0xdeadbeef;
+    nextStart.bubble = false;
+
+    retired = StageRegister();
+    stageAt(0) = nextStart;
+    functionalStage = 0;
+
+    if (switchToPipelined) {
+        switchToPipelined = false;
+        isPipelined = true;
+    }
+}
+
+// Drops whatever the pipeline has in flight and restarts the oldest
+// instruction that hasn't been written back as the functional one.
+void N16R::enterFunctional() {
+    StageRegister nextStart;
+    nextStart.instructionPointer = resetAddress;
+
+    for (int i = 4; i >= 0; i--) {
+        auto &stage = stageAt(i);
+        if (stage.bubble) {
+            continue;
+        }
+        if (nextStart.bubble) {
+            nextStart.instructionPointer = stage.instructionPointer;
+            nextStart.bubble = false;
+        }
+        // only a write that made it through the memory stage holds an operation
+        if (i == 4 && stage.commitOp == CommitWrite && !stage.exception) {
+            memoryUnit.invalidateOperation(stage.memory[0]);
+        }
+    }
+    nextStart.nextInstructionPointer = nextStart.instructionPointer;
+    nextStart.altInstructionPointer  = 0xdeadbeef;
+    nextStart.bubble = false;
+
+    stageHead = 0;
+    for (auto &stage: stageRing) {
+        stage = StageRegister();
+    }
+    stageAt(0) = nextStart;
+    updateScoreboard();
+
+    functionalStage = 0;
+    isPipelined = false;
+}
+
+void N16R::flushTranslations() {
+    translatedBlocks.assign(useTranslation ? (1 << translateCacheBits) : 0, TranslatedBlock());
+    memoryUnit.clearCodePages();
+    translatedGeneration = memoryUnit.getCodeGeneration();
+}
+
+// Translation reads the code as the instruction cache holds it right now and
+// stops at anything it can't run on its own: code that isn't cached,
+// breakpoints, privileged instructions and writes to the special registers.
+void N16R::translateBlock(TranslatedBlock &block) {
+    block.entries = 0;
+    block.privileged = false;
+    block.instructions.clear();
+
+    uint32_t address = block.address;
+    while (block.instructions.size() < translateBlockLimit && !breakpoints.contains(address)) {
+        uint16_t words[2] = {0, 0};
+        if (!memoryUnit.peekInstruction(address, words[0])) {
+            break;
+        }
+        words[0] = byteswap(words[0]);
+
+        TranslatedInstruction instruction;
+        instruction.address = address;
+        instruction.nextAddress = address + 2;
+
+        bool wide = false;
+        bool endsBlock = false;
+        uint8_t opcode = (words[0] >> 12) & 0xf;
+        if (opcode == 002 || opcode == 006 || opcode == 007 || opcode == 017) {
+            if (!memoryUnit.peekInstruction(address + 2, words[1])) {
+                break;
+            }
+            words[1] = byteswap(words[1]);
+            instruction.nextAddress = address + 4;
+            wide = true;
+
+            if (opcode == 007 || opcode == 017) {
+                uint32_t baseI = words[0] & 0xfff;
+                uint32_t extrI = words[1];
+                instruction.nextAddress = address & 0xe0000000 | (baseI << 17) | (extrI << 1);
+                endsBlock = true;
+            }
+        }
+
+        auto &decoded = instruction.decoded;
+        decodeInstruction(words[0], words[1], decoded);
+        if (decoded.invalid || decoded.privileged) {
+            break;
+        }
+        bool special = false;
+        for (int i = 0; i < 7; i++) {
+            special = special || (decoded.dstRegs[i] != StageRegister::emptyRegister && decoded.dstRegs[i] >= causeRegister);
+        }
+        if (special) {
+            break;
+        }
+
+        MemoryOp memoryOp = decoded.setsMemoryOp ? decoded.memoryOp : MemoryNop;
+        if (memoryOp != MemoryNop && !decoded.setsMemoryBytes) {
+            break;
+        }
+
+        switch (decoded.commitOp) {
+            case CommitNop:
+            case CommitWriteBack:
+                if (memoryOp == MemoryNop) {
+                    instruction.handler = &N16R::translatedOperation;
+                }
+                else if (memoryOp == MemoryRead && decoded.commitOp == CommitWriteBack) {
+                    instruction.handler = &N16R::translatedLoad;
+                }
+                break;
+            case CommitWrite:
+                if (memoryOp == MemoryWrite) {
+                    instruction.handler = &N16R::translatedStore;
+                }
+                break;
+            case CommitJump:
+            case CommitDecideEQ:
+            case CommitDecideNE:
+            case CommitDecideGT:
+            case CommitDecideLE:
+            case CommitDecideLT:
+            case CommitDecideGE:
+                if (memoryOp == MemoryNop) {
+                    instruction.handler = &N16R::translatedBranch;
+                    endsBlock = true;
+                }
+                break;
+            default:
+                break;
+        }
+        if (!instruction.handler) {
+            break;
+        }
+
+        if (memoryUnit.isKernelSegment(address) || (wide && memoryUnit.isKernelSegment(address + 2))) {
+            block.privileged = true;
+        }
+        memoryUnit.watchCodePage(address);
+        if (wide) {
+            memoryUnit.watchCodePage(address + 2);
+        }
+
+        block.instructions.push_back(instruction);
+        address = instruction.nextAddress;
+
+        if (endsBlock || decoded.jumpToRegister) {
+            break;
+        }
+    }
+
+    block.translated = !block.instructions.empty();
+    if (block.translated) {
+        translatedBlockCount++;
+    }
+}
+
+// Runs translated blocks from the instruction about to be fetched, going from
+// block to block within the clock. Whatever a block can't finish without
+// waiting on memory or raising an exception is left to the stages, starting
+// at the instruction that couldn't complete. Returns the number retired.
+int N16R::runTranslated() {
+    if (memoryUnit.getCodeGeneration() != translatedGeneration) {
+        flushTranslations();
+    }
+    // interrupts are taken in write back, and watched memory is only
+    // checked by the memory stage
+    if ((hasInterrupts() && (registerFile[statusRegister] & 1)) || breakpoints.hasWatchpoints()) {
+        return 0;
+    }
+
+    uint32_t address = stageAt(0).instructionPointer;
+    int retired = 0;
+    int flushes = 0;
+    bool completed = true;
+
+    while (completed && retired < translateRunLimit) {
+        auto &block = translatedBlocks[(address >> 1) & ((1 << translateCacheBits) - 1)];
+        if (block.address != address) {
+            block = TranslatedBlock();
+            block.address = address;
+        }
+        if (!block.translated) {
+            if (++block.entries < translateThreshold) {
+                break;
+            }
+            translateBlock(block);
+            if (!block.translated) {
+                break;
+            }
+        }
+        if (block.privileged && !isKernel()) {
+            break;
+        }
+
+        for (auto &instruction: block.instructions) {
+            uint32_t next;
+            if (!(this->*instruction.handler)(instruction, next)) {
+                completed = false;
+                break;
+            }
+            if (instruction.handler == &N16R::translatedBranch && next != instruction.nextAddress) {
+                flushes++;
+            }
+
+            retiredAddresses.push_back(instruction.address);
+            retired++;
+            address = next;
+
+            // a store went to translated code
+            if (memoryUnit.getCodeGeneration() != translatedGeneration) {
+                completed = false;
+                break;
+            }
+        }
+    }
+
+    if (retired == 0) {
+        return 0;
+    }
+
+    lastBreakpoint = 0;
+    breakpointWasHit = false;
+
+    retiredCount += retired;
+    translatedRetired += retired;
+    clockCount += retired - 1 + flushes * functionalFlushCost;
+    owedCycles = retired - 1;
+
+    StageRegister nextStart;
+    nextStart.instructionPointer = address;
+    nextStart.nextInstructionPointer = address;
+    nextStart.altInstructionPointer  = 0xdeadbeef;
+    nextStart.bubble = false;
+    stageAt(0) = nextStart;
+
+    return retired;
+}
+
+bool N16R::translatedOperation(const TranslatedInstruction &instruction, uint32_t &next) {
+    auto &decoded = instruction.decoded;
+    uint16_t operands[5] = {};
+    uint16_t result[5] = {};
+    uint16_t memory[2] = {};
+
+    readOperands(decoded, instruction.address, operands);
+    if (executeOperation(decoded.executeOp, decoded.executeCanOverflow, operands, result)) {
+        return false;
+    }
+    if (decoded.commitOp == CommitWriteBack) {
+        writeRegisters(decoded.dstRegs, result, memory);
+    }
+
+    next = decoded.jumpToRegister ? getDWord(2, operands) : instruction.nextAddress;
+    return true;
+}
+
+bool N16R::translatedLoad(const TranslatedInstruction &instruction, uint32_t &next) {
+    auto &decoded = instruction.decoded;
+    uint16_t operands[5] = {};
+    uint16_t result[5] = {};
+    uint16_t memory[2] = {};
+
+    readOperands(decoded, instruction.address, operands);
+    if (executeOperation(decoded.executeOp, decoded.executeCanOverflow, operands, result)) {
+        return false;
+    }
+
+    uint32_t asid = getRegisterDWord(asidRegister);
+    uint32_t memoryAddress = getDWord(0, result);
+    if (memoryUnit.check(MemoryOpDataRead, memoryAddress, decoded.memoryBytes, asid).result != MemoryCheckContainsSingle) {
+        return false;
+    }
+
+    uint32_t memoryValue = memoryUnit.read(DataCache, memoryAddress, decoded.memoryBytes, asid);
+    if (decoded.memoryBytes == 1) {
+        memory[0] = memoryValue & 0xff;
+    }
+    else {
+        memory[0] = memoryValue & 0xffff;
+        if (decoded.memoryBytes > 2) {
+            memory[1] = memoryValue >> 16;
+        }
+    }
+    writeRegisters(decoded.dstRegs, result, memory);
+
+    next = instruction.nextAddress;
+    return true;
+}
+
+bool N16R::translatedStore(const TranslatedInstruction &instruction, uint32_t &next) {
+    auto &decoded = instruction.decoded;
+    uint16_t operands[5] = {};
+    uint16_t result[5] = {};
+
+    readOperands(decoded, instruction.address, operands);
+    if (executeOperation(decoded.executeOp, decoded.executeCanOverflow, operands, result)) {
+        return false;
+    }
+
+    uint32_t asid = getRegisterDWord(asidRegister);
+    uint32_t memoryAddress = getDWord(0, result);
+    if (memoryUnit.check(MemoryOpDataWrite, memoryAddress, decoded.memoryBytes, asid).isException()) {
+        return false;
+    }
+
+    uint16_t operationId = memoryUnit.queueOperation(writeOperation(memoryAddress, decoded.memoryBytes, operands + 3, asid));
+    if (operationId == MemoryOperation::invalidOperationId) {
+        return false;
+    }
+    memoryUnit.commitOperation(operationId);
+
+    next = instruction.nextAddress;
+    return true;
+}
+
+bool N16R::translatedBranch(const TranslatedInstruction &instruction, uint32_t &next) {
+    auto &decoded = instruction.decoded;
+    uint16_t operands[5] = {};
+    uint16_t result[5] = {};
+
+    readOperands(decoded, instruction.address, operands);
+    if (executeOperation(decoded.executeOp, decoded.executeCanOverflow, operands, result)) {
+        return false;
+    }
+
+    uint32_t target = instruction.nextAddress;
+    next = instruction.nextAddress;
+    if (decoded.hasBranchOffset) {
+        target = instruction.address + decoded.branchOffset;
+    }
+    if (decoded.jumpToRegister) {
+        target = getDWord(2, operands);
+        next = target;
+    }
+
+    if (isBranchTaken(decoded.commitOp, result[0])) {
+        next = target;
+    }
+    return true;
+}
+
 void N16R::fetchStage() {
     if (halted) {
-        machine->debug(7, "Fetch is halted.");
+        SYSNP_DEBUG(machine, 7, "Fetch is halted.");
         return;
     }
-    if (stageRegisters[0].bubble) {
-        machine->debug(7, "Fetch is bubble.");
+    if (stageAt(0).bubble) {
+        SYSNP_DEBUG(machine, 7, "Fetch is bubble.");
         return;
     }
 
-    StageRegister stage = stageRegisters[0];
+    auto &stage = stageAt(0);
 
     uint32_t asid = 0;
 
-    if (breakpoints.contains(stage.instructionPointer)) {
+    // the registers a condition tests may still be on their way through
+    // the pipeline, so it waits for them
+    if (isPipelined && breakpoints.isConditional(stage.instructionPointer)) {
+        if (!isPipelineDrained()) {
+            stage.delayed = true;
+            breakpointDrain = true;
+            return;
+        }
+        if (breakpointDrain) {
+            stage.delayed = false;
+            breakpointDrain = false;
+        }
+    }
+
+    if (breakpoints.isHit(stage.instructionPointer, registerFile)) {
         if (stage.instructionPointer != lastBreakpoint) {
             lastBreakpoint = stage.instructionPointer;
             breakpointWasHit = true;
@@ -185,13 +799,12 @@ void N16R::fetchStage() {
         stage.exception = true;
         stage.exceptionAddress = checkWord;
 
-        stageRegisters[0] = stage;
         return;
     }
 
     bool secondWordFetched = false;
     if (stage.delayed && stage.instructionPointer != stage.nextInstructionPointer) {
-        machine->debug("Fetch pre-delayed");
+        SYSNP_DEBUG(machine, 3, "Fetch pre-delayed");
 
         if (memCheck.isComplete()) {
             stage.fetch[1] = byteswap(memoryUnit.read(InstructionCache, checkWord, 2, asid));
@@ -205,17 +818,17 @@ void N16R::fetchStage() {
     }
     else {
         if (memCheck.isComplete()) {
-            machine->debug("Fetch found");
+            SYSNP_DEBUG(machine, 3, "Fetch found");
             stage.fetch[0] = byteswap(memoryUnit.read(InstructionCache, checkWord, 2, asid));
             stage.delayed = false;
         }
         else if (!stage.delayed) {
-            machine->debug("Fetch queued");
+            SYSNP_DEBUG(machine, 3, "Fetch queued");
             memoryUnit.queueRead(InstructionRead, checkWord, 2, asid);
             stage.delayed = true;
         }
         else {
-            machine->debug("Waiting for instruction data");
+            SYSNP_DEBUG(machine, 3, "Waiting for instruction data");
         }
     }
 
@@ -243,7 +856,6 @@ void N16R::fetchStage() {
                 stage.exception = true;
                 stage.exceptionAddress = nextWord;
 
-                stageRegisters[0] = stage;
                 return;
             }
 
@@ -267,37 +879,156 @@ void N16R::fetchStage() {
 
         stage.altInstructionPointer = stage.nextInstructionPointer;
     }
-
-    stageRegisters[0] = stage;
 }
 
 void N16R::decodeStage() {
     if (halted) {
-        machine->debug(7, "Decode is halted.");
+        SYSNP_DEBUG(machine, 7, "Decode is halted.");
         return;
     }
-    if (stageRegisters[1].bubble) {
-        machine->debug(7, "Decode is bubble.");
+    if (stageAt(1).bubble) {
+        SYSNP_DEBUG(machine, 7, "Decode is bubble.");
         return;
     }
-    if (stageRegisters[1].exception) {
-        machine->debug(7, "Decode is exception.");
+    if (stageAt(1).exception) {
+        SYSNP_DEBUG(machine, 7, "Decode is exception.");
         return;
     }
 
-    auto stage = stageRegisters[1];
+    auto &stage = stageAt(1);
 
-    stage.commitOp = CommitNop;
-    stage.executeOp = ExecuteNop;
-    stage.executeCanOverflow = CanNotOverflow;
+    DecodedInstruction scratch;
+    DecodedInstruction *decoded = &scratch;
+    if (useDecodeCache) {
+        decoded = &decodeCache[(stage.instructionPointer >> 1) & ((1 << decodeCacheBits) - 1)];
+        if (decoded->valid && decoded->address == stage.instructionPointer && decoded->instruction == stage.fetch[0] &&
+                (!decoded->usesExtension || decoded->extension == stage.fetch[1])) {
+            decodeCacheHits++;
+        }
+        else {
+            decodeCacheMisses++;
+            *decoded = DecodedInstruction();
+            decodeInstruction(stage.fetch[0], stage.fetch[1], *decoded);
+            decoded->address = stage.instructionPointer;
+            decoded->valid = true;
+        }
+    }
+    else {
+        decodeInstruction(stage.fetch[0], stage.fetch[1], scratch);
+    }
 
-    auto instruction = stage.fetch[0];
-    uint8_t opcode = (instruction >> 12) & 0xf;
+    stage.commitOp = decoded->commitOp;
+    stage.executeOp = decoded->executeOp;
+    stage.executeCanOverflow = decoded->executeCanOverflow;
+    if (decoded->setsMemoryOp) {
+        stage.memoryOp = decoded->memoryOp;
+    }
+    if (decoded->setsMemoryBytes) {
+        stage.memoryBytes = decoded->memoryBytes;
+    }
+    if (decoded->clearsExceptionType) {
+        stage.exceptionType = ExceptNone;
+    }
+    if (decoded->invalid) {
+        stage.exception = true;
+    }
+
+    readOperands(*decoded, stage.instructionPointer, stage.decode);
+    for (int i = 0; i < 5; i++) {
+        if (decoded->srcRegs[i] != StageRegister::emptyRegister) {
+            stage.srcRegs[i] = decoded->srcRegs[i];
+        }
+    }
+    for (int i = 0; i < 7; i++) {
+        if (decoded->dstRegs[i] != StageRegister::emptyRegister) {
+            stage.dstRegs[i] = decoded->dstRegs[i];
+        }
+    }
+    if (decoded->hasBranchOffset) {
+        stage.altInstructionPointer = stage.instructionPointer + decoded->branchOffset;
+    }
 
     uint32_t target;
 
-    bool latePopulateNext = false;
-    bool isPrivileged = false;
+    bool latePopulateNext = decoded->jumpToRegister;
+    bool isPrivileged = decoded->privileged;
+
+    if (stage.exception && stage.exceptionType == ExceptNone) {
+        stage.exceptionType = ExceptInvalidInstruction;
+    }
+
+    stage.privileged = stage.privileged || isPrivileged;
+    if (isPrivileged) {
+        stage.privilegedInstruction;
+    }
+
+    stage.delayed = false;
+    // Check register hazards; the nearest stage writing a source decides
+    uint64_t sources = 0;
+    for (int i = 0; i < 5; i++) {
+        if (stage.srcRegs[i] != StageRegister::emptyRegister) {
+            sources |= 1ull << stage.srcRegs[i];
+        }
+    }
+    for (int i = 0; (sources & scoreboard) && i < 5; i++) {
+        if (stage.srcRegs[i] == StageRegister::emptyRegister) {
+            continue;
+        }
+        uint64_t reg = 1ull << stage.srcRegs[i];
+        unsigned writers = 0;
+        for (int s = 2; s < 5; s++) {
+            if (((executeWrites[s] | memoryWrites[s]) & reg) && !stageAt(s).bubble) {
+                writers |= 1 << s;
+            }
+        }
+        if (!writers) {
+            continue;
+        }
+        int s = std::countr_zero(writers);
+        // a load still in flight, or one waiting on memory, has nothing to forward yet
+        if (s == 2 ? !(executeWrites[s] & reg) : stageAt(s).delayed) {
+            stage.delayed = true;
+            break;
+        }
+        stage.decode[i] = stageAt(s).operandForward(stage.srcRegs[i], s);
+    }
+
+    if (latePopulateNext) {
+        target = stage.decode[2];
+        target |= ((uint32_t) stage.decode[3]) << 16;
+
+        stage.nextInstructionPointer = target;
+        stage.altInstructionPointer = target;
+    }
+}
+
+void N16R::readOperands(const DecodedInstruction &decoded, uint32_t address, uint16_t *operands) {
+    uint32_t link = address + decoded.linkOffset;
+    for (int i = 0; i < 5; i++) {
+        switch (decoded.operandSource[i]) {
+            case OperandRegister:
+                operands[i] = registerFile[decoded.operandValue[i]];
+                break;
+            case OperandImmediate:
+                operands[i] = decoded.operandValue[i];
+                break;
+            case OperandLinkLow:
+                operands[i] = link & decoded.linkMask;
+                break;
+            case OperandLinkHigh:
+                operands[i] = link >> 16;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void N16R::decodeInstruction(uint16_t instruction, uint16_t extension, DecodedInstruction &decoded) {
+    decoded.instruction = instruction;
+    decoded.extension = extension;
+
+    uint8_t opcode = (instruction >> 12) & 0xf;
 
     if (opcode == 000) {
         // R
@@ -306,9 +1037,9 @@ void N16R::decodeStage() {
         uint8_t bReg = (instruction >> 6) & 07;
         uint8_t func = instruction & 077;
 
-        stage.commitOp = CommitWriteBack;
+        decoded.commitOp = CommitWriteBack;
 
-        stage.exceptionType = ExceptNone;
+        decoded.clearsExceptionType = true;
 
         bool isDouble = false;
         bool isCustom = false;
@@ -324,145 +1055,144 @@ void N16R::decodeStage() {
             case 001: // mov.32 D->D
                 isDouble = true;
             case 000: // mov.16 D->D
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 break;
             case 003: // xch.32 D<>D
                 isDouble = true;
             case 002: // xch.16 D<>D
-                stage.executeOp = ExecuteExchange;
+                decoded.executeOp = ExecuteExchange;
                 isExchange = true;
                 break;
 
             case 010: // add.16
-                stage.executeCanOverflow = CanOverflow16;
+                decoded.executeCanOverflow = CanOverflow16;
             case 011: // addu.16
-                stage.executeOp = ExecuteAdd;
+                decoded.executeOp = ExecuteAdd;
                 break;
             case 012: // sub.16
-                stage.executeCanOverflow = CanOverflow16;
+                decoded.executeCanOverflow = CanOverflow16;
             case 013: // subu.16
-                stage.executeOp = ExecuteSubtract;
+                decoded.executeOp = ExecuteSubtract;
                 break;
             case 014: // add.32
-                stage.executeCanOverflow = CanOverflow32;
+                decoded.executeCanOverflow = CanOverflow32;
             case 015: // addu.32
-                stage.executeOp = ExecuteAdd;
+                decoded.executeOp = ExecuteAdd;
                 isDouble = true;
                 break;
             case 016: // sub.32
-                stage.executeCanOverflow = CanOverflow32;
+                decoded.executeCanOverflow = CanOverflow32;
             case 017: // subu.32
-                stage.executeOp = ExecuteSubtract;
+                decoded.executeOp = ExecuteSubtract;
                 isDouble = true;
                 break;
 
             case 020: // and.16
-                stage.executeOp = ExecuteAnd;
+                decoded.executeOp = ExecuteAnd;
                 break;
             case 021: // or.16
-                stage.executeOp = ExecuteOr;
+                decoded.executeOp = ExecuteOr;
                 break;
             case 022: // xor.16
-                stage.executeOp = ExecuteXor;
+                decoded.executeOp = ExecuteXor;
                 break;
             case 023: // nor.16
-                stage.executeOp = ExecuteNor;
+                decoded.executeOp = ExecuteNor;
                 break;
 
             case 030: // mov.16 S->D
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 bRegBank = 040;
-                isPrivileged = true;
+                decoded.privileged = true;
                 break;
             case 031: // mov.16 D->S
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 aRegBank = 040;
-                isPrivileged = true;
+                decoded.privileged = true;
                 break;
             case 032: // mov.32 S->D
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 isDouble = true;
                 bRegBank = 040;
-                isPrivileged = true;
+                decoded.privileged = true;
                 break;
             case 033: // mov.32 D->S
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 isDouble = true;
                 aRegBank = 040;
-                isPrivileged = true;
+                decoded.privileged = true;
                 break;
 
             case 042: // mov.32 A->D
                 isDouble = true;
             case 040: // mov.16 A->D
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 bRegBank = 020;
                 break;
             case 043: // mov.32 D->A
                 isDouble = true;
             case 041: // mov.16 D->A
-                stage.executeOp = ExecutePickB;
+                decoded.executeOp = ExecutePickB;
                 aRegBank = 020;
                 break;
             case 045: // xch.32 D<>A
                 isDouble = true;
             case 044: // xch.16 D<>A
-                stage.executeOp = ExecuteExchange;
+                decoded.executeOp = ExecuteExchange;
                 aRegBank = 020;
                 isExchange = true;
                 break;
 
             case 050: // syscall
-                stage.commitOp = CommitSyscall;
+                decoded.commitOp = CommitSyscall;
                 isCustom = true;
                 break;
             case 051: // eret
-                stage.commitOp = CommitExceptionReturn;
-                isPrivileged = true;
+                decoded.commitOp = CommitExceptionReturn;
+                decoded.privileged = true;
                 isCustom = true;
                 break;
             case 053: // eret A
                 aRegBank = 020;
             case 052: // eret D
-                stage.commitOp = CommitExceptionReturnJump;
-                isPrivileged = true;
+                decoded.commitOp = CommitExceptionReturnJump;
+                decoded.privileged = true;
                 isDouble = true;
                 aRegOnly = true;
                 break;
 
             case 054: // hlt
-                stage.commitOp = CommitHalt;
-                isPrivileged = true;
+                decoded.commitOp = CommitHalt;
+                decoded.privileged = true;
                 isCustom = true;
                 break;
 
             case 055: // ltlb
-                stage.commitOp = CommitLoadTlb;
-                isPrivileged = true;
+                decoded.commitOp = CommitLoadTlb;
+                decoded.privileged = true;
                 isDouble = true;
                 break;
             case 056: // xtlb
-                stage.commitOp = CommitExpireTlb;
-                isPrivileged = true;
+                decoded.commitOp = CommitExpireTlb;
+                decoded.privileged = true;
                 isDouble = true;
                 aRegOnly = true;
                 break;
             case 057: // ftlb
-                stage.commitOp = CommitFlushTlb;
-                isPrivileged = true;
+                decoded.commitOp = CommitFlushTlb;
+                decoded.privileged = true;
                 isCustom = true;
                 break;
 
             case 072: // jalr D
             case 073: // jalr A
-                stage.decode[0] = (stage.instructionPointer + 2) & 0xff;
-                stage.decode[1] = (stage.instructionPointer + 2) >> 16;
-                stage.dstRegs[0] = 016;
-                stage.dstRegs[1] = 017;
+                decoded.setLink(2, 0xff);
+                decoded.dstRegs[0] = 016;
+                decoded.dstRegs[1] = 017;
             case 070: // jr D
             case 071: // jr A
                 if (func == 070 || func == 071) {
-                    stage.commitOp = CommitJump;
+                    decoded.commitOp = CommitJump;
                 }
 
                 aReg <<= 1;
@@ -470,17 +1200,17 @@ void N16R::decodeStage() {
                     aReg += 020;
                 }
 
-                stage.decode[2] = registerFile[aReg];
-                stage.decode[3] = registerFile[aReg + 1];
-                stage.srcRegs[2] = aReg;
-                stage.srcRegs[3] = aReg + 1;
+                decoded.setRegister(2, aReg);
+                decoded.setRegister(3, aReg + 1);
+                decoded.srcRegs[2] = aReg;
+                decoded.srcRegs[3] = aReg + 1;
 
-                latePopulateNext = true;
+                decoded.jumpToRegister = true;
 
                 isCustom = true;
                 break;
             default:
-                stage.exception = true;
+                decoded.invalid = true;
                 break;
         }
 
@@ -492,16 +1222,16 @@ void N16R::decodeStage() {
                 aReg += aRegBank;
                 bReg += bRegBank;
 
-                stage.decode[1] = registerFile[aReg + 1];
-                stage.decode[3] = registerFile[bReg + 1];
-                stage.srcRegs[1] = aReg + 1;
+                decoded.setRegister(1, aReg + 1);
+                decoded.setRegister(3, bReg + 1);
+                decoded.srcRegs[1] = aReg + 1;
 
                 if (!aRegOnly) {
-                    stage.srcRegs[3] = bReg + 1;
-                    stage.dstRegs[1] = aReg + 1;
+                    decoded.srcRegs[3] = bReg + 1;
+                    decoded.dstRegs[1] = aReg + 1;
 
                     if (isExchange) {
-                        stage.dstRegs[3] = bReg + 1;
+                        decoded.dstRegs[3] = bReg + 1;
                     }
                 }
             }
@@ -510,16 +1240,16 @@ void N16R::decodeStage() {
                 bReg += bRegBank;
             }
 
-            stage.decode[0] = registerFile[aReg];
-            stage.decode[2] = registerFile[bReg];
-            stage.srcRegs[0] = aReg;
+            decoded.setRegister(0, aReg);
+            decoded.setRegister(2, bReg);
+            decoded.srcRegs[0] = aReg;
 
             if (!aRegOnly) {
-                stage.srcRegs[2] = bReg;
-                stage.dstRegs[0] = aReg;
+                decoded.srcRegs[2] = bReg;
+                decoded.dstRegs[0] = aReg;
 
                 if (isExchange) {
-                    stage.dstRegs[2] = bReg;
+                    decoded.dstRegs[2] = bReg;
                 }
             }
         }
@@ -527,15 +1257,14 @@ void N16R::decodeStage() {
     else if (opcode == 007 || opcode == 017) {
         // J
 
-        stage.executeOp = ExecuteAdd;
-        stage.memoryOp = MemoryNop;
+        decoded.executeOp = ExecuteAdd;
+        decoded.setMemoryOp(MemoryNop);
 
         if (opcode == 007) {
-            stage.decode[0] = (stage.instructionPointer + 4) & 0xffff;
-            stage.decode[1] = (stage.instructionPointer + 4) >> 16;
-            stage.dstRegs[0] = 016;
-            stage.dstRegs[1] = 017;
-            stage.commitOp = CommitWriteBack;
+            decoded.setLink(4, 0xffff);
+            decoded.dstRegs[0] = 016;
+            decoded.dstRegs[1] = 017;
+            decoded.commitOp = CommitWriteBack;
         }
     }
     else if (opcode == 001 || ((opcode & 010) == 010)) { // 017 is covered by the earlier check
@@ -545,55 +1274,55 @@ void N16R::decodeStage() {
         uint8_t func = (instruction >> 8) & 0001;
         uint8_t imm  =  instruction       & 0377;
 
-        stage.memoryOp = MemoryNop;
-        stage.commitOp = CommitWriteBack;
+        decoded.setMemoryOp(MemoryNop);
+        decoded.commitOp = CommitWriteBack;
 
         bool signExtend = false;
 
-        stage.srcRegs[0] = aReg;
-        stage.dstRegs[0] = aReg;
-        stage.decode[2] = imm;
+        decoded.srcRegs[0] = aReg;
+        decoded.dstRegs[0] = aReg;
+        decoded.setImmediate(2, imm);
 
         switch (opcode) {
             case 001: // addiu, subiu
                 aReg <<= 1;
-                stage.srcRegs[0] = aReg;
-                stage.srcRegs[1] = aReg + 1;
-                stage.dstRegs[0] = aReg;
-                stage.dstRegs[1] = aReg + 1;
+                decoded.srcRegs[0] = aReg;
+                decoded.srcRegs[1] = aReg + 1;
+                decoded.dstRegs[0] = aReg;
+                decoded.dstRegs[1] = aReg + 1;
 
-                stage.decode[1] = registerFile[stage.srcRegs[1]];
+                decoded.setRegister(1, decoded.srcRegs[1]);
 
-                stage.executeOp = func ? ExecuteSubtractHalf : ExecuteAddHalf;
+                decoded.executeOp = func ? ExecuteSubtractHalf : ExecuteAddHalf;
                 break;
             case 010: // addiu
-                stage.executeOp = ExecuteAddHalf;
+                decoded.executeOp = ExecuteAddHalf;
                 if (!func) {
-                    stage.executeCanOverflow = CanOverflow16;
+                    decoded.executeCanOverflow = CanOverflow16;
                     signExtend = true;
                 }
                 break;
             case 011: // subiu
-                stage.executeOp = ExecuteSubtractHalf;
+                decoded.executeOp = ExecuteSubtractHalf;
                 if (!func) {
-                    stage.executeCanOverflow = CanOverflow16;
+                    decoded.executeCanOverflow = CanOverflow16;
                     signExtend = true;
                 }
                 break;
             case 012: // lui, lli
-                stage.executeOp = func ? ExecuteLoadLowerImmediate : ExecuteLoadUpperImmediate;
+                decoded.executeOp = func ? ExecuteLoadLowerImmediate : ExecuteLoadUpperImmediate;
                 break;
             case 013: // and, or
-                stage.executeOp = func ? ExecuteOr : ExecuteAnd;
+                decoded.executeOp = func ? ExecuteOr : ExecuteAnd;
                 break;
             case 014: // xor, lsh
-                stage.executeOp = func ? ExecuteLeftShift : ExecuteXor;
+                decoded.executeOp = func ? ExecuteLeftShift : ExecuteXor;
                 break;
             case 015: // lsha, rsh
-                stage.executeOp = func ? ExecuteRightShift : ExecuteRightShiftArithmetic;
+                decoded.executeOp = func ? ExecuteRightShift : ExecuteRightShiftArithmetic;
                 break;
             case 016: // slt
-                stage.executeOp = ExecuteSetLessThan;
+                decoded.executeOp = ExecuteSetLessThan;
                 if (!func) {
                     signExtend = true;
                 }
@@ -604,9 +1333,9 @@ void N16R::decodeStage() {
         }
 
         if (signExtend) {
-            stage.decode[2] = e8s16(stage.decode[2]);
+            decoded.operandValue[2] = e8s16(decoded.operandValue[2]);
         }
-        stage.decode[0] = registerFile[stage.srcRegs[0]];
+        decoded.setRegister(0, decoded.srcRegs[0]);
     }
     else if (opcode == 002 || opcode == 003) {
         // M/E
@@ -617,159 +1346,130 @@ void N16R::decodeStage() {
 
         if (opcode == 002) {
             func = instruction & 077;
-            stage.decode[2] = stage.fetch[1];
+            decoded.setImmediate(2, extension);
+            decoded.usesExtension = true;
         }
         else {
             func = instruction & 07;
 
             uint8_t cReg = (instruction >> 3) & 07;
-            stage.decode[2] = registerFile[cReg];
-            stage.srcRegs[2] = cReg;
+            decoded.setRegister(2, cReg);
+            decoded.srcRegs[2] = cReg;
         }
 
-        stage.decode[0] = registerFile[bReg];
-        stage.decode[1] = registerFile[bReg + 1];
-        stage.srcRegs[0] = bReg;
-        stage.srcRegs[1] = bReg + 1;
+        decoded.setRegister(0, bReg);
+        decoded.setRegister(1, bReg + 1);
+        decoded.srcRegs[0] = bReg;
+        decoded.srcRegs[1] = bReg + 1;
 
-        stage.executeOp = ExecuteAddHalf;
+        decoded.executeOp = ExecuteAddHalf;
 
         switch (func) {
             case 2: // ld
                 aReg <<= 1;
-                stage.dstRegs[6] = aReg + 1;
+                decoded.dstRegs[6] = aReg + 1;
             case 0: // lb
             case 1: // lw
-                stage.memoryOp = MemoryRead;
-                stage.memoryBytes = func == 0 ? 1 : (func == 1 ? 2 : 4);
-                stage.commitOp = CommitWriteBack;
-                stage.dstRegs[5] = aReg;
+                decoded.setMemoryOp(MemoryRead);
+                decoded.setMemoryBytes(func == 0 ? 1 : (func == 1 ? 2 : 4));
+                decoded.commitOp = CommitWriteBack;
+                decoded.dstRegs[5] = aReg;
                 break;
             case 6: // sd
                 aReg <<= 1;
-                stage.decode[4] = registerFile[aReg + 1];
-                stage.srcRegs[4] = aReg + 1;
+                decoded.setRegister(4, aReg + 1);
+                decoded.srcRegs[4] = aReg + 1;
             case 4: // sb
             case 5: // sw
-                stage.memoryOp = MemoryWrite;
-                stage.memoryBytes = func == 4 ? 1 : (func == 5 ? 2 : 4);
-                stage.commitOp = CommitWrite;
-                stage.decode[3] = registerFile[aReg];
-                stage.srcRegs[3] = aReg;
+                decoded.setMemoryOp(MemoryWrite);
+                decoded.setMemoryBytes(func == 4 ? 1 : (func == 5 ? 2 : 4));
+                decoded.commitOp = CommitWrite;
+                decoded.setRegister(3, aReg);
+                decoded.srcRegs[3] = aReg;
                 break;
             default:
-                stage.exception = true;
+                decoded.invalid = true;
                 break;
         }
     }
     else if (opcode == 006) {
         // B
-        uint32_t offset = e16s32(stage.fetch[1]);
-        stage.altInstructionPointer = stage.instructionPointer + (offset << 1);
+        uint32_t offset = e16s32(extension);
+        decoded.branchOffset = offset << 1;
+        decoded.hasBranchOffset = true;
+        decoded.usesExtension = true;
 
         uint8_t aReg = (instruction >> 9) & 07;
         uint8_t bReg = (instruction >> 6) & 07;
 
         uint8_t func = instruction & 077;
 
-        stage.decode[0] = registerFile[aReg];
-        stage.decode[1] = 0;
-        stage.decode[2] = registerFile[bReg];
-        stage.decode[3] = 0;
+        decoded.setRegister(0, aReg);
+        decoded.setImmediate(1, 0);
+        decoded.setRegister(2, bReg);
+        decoded.setImmediate(3, 0);
 
-        stage.srcRegs[0] = aReg;
-        stage.srcRegs[2] = bReg;
+        decoded.srcRegs[0] = aReg;
+        decoded.srcRegs[2] = bReg;
 
-        stage.executeOp = ExecuteSubtract;
-        stage.memoryOp = MemoryNop;
+        decoded.executeOp = ExecuteSubtract;
+        decoded.setMemoryOp(MemoryNop);
 
         switch (func) {
             case 0:
-                stage.commitOp = CommitDecideEQ;
+                decoded.commitOp = CommitDecideEQ;
                 break;
             case 1:
-                stage.commitOp = CommitDecideNE;
+                decoded.commitOp = CommitDecideNE;
                 break;
             case 2:
-                stage.commitOp = CommitDecideGT;
+                decoded.commitOp = CommitDecideGT;
                 break;
             case 3:
-                stage.commitOp = CommitDecideLE;
+                decoded.commitOp = CommitDecideLE;
                 break;
             case 4:
-                stage.commitOp = CommitDecideLT;
+                decoded.commitOp = CommitDecideLT;
                 break;
             case 5:
-                stage.commitOp = CommitDecideGE;
+                decoded.commitOp = CommitDecideGE;
                 break;
             default:
-                stage.exception = true;
+                decoded.invalid = true;
                 break;
         }
     }
     else {
         // Invalid instruction opcode
-        stage.exception = true;
-    }
-
-    if (stage.exception && stage.exceptionType == ExceptNone) {
-        stage.exceptionType = ExceptInvalidInstruction;
-    }
-
-    stage.privileged = stage.privileged || isPrivileged;
-    if (isPrivileged) {
-        stage.privilegedInstruction;
+        decoded.invalid = true;
     }
-
-    stage.delayed = false;
-    // Check register hazards
-    for (int i = 0; i < 5; i++) {
-        if (stage.srcRegs[i] == StageRegister::emptyRegister) {
-            continue;
-        }
-        for (int s = 2; s < 5; s++) {
-            OperandHazard hazard = stageRegisters[s].checkOperandHazard(stage.srcRegs[i], s);
-            if (hazard == OperandHazardNone) {
-                continue;
-            }
-            if (hazard == OperandHazardNext) {
-                stage.delayed = true;
-                break;
-            }
-            stage.decode[i] = stageRegisters[s].operandForward(stage.srcRegs[i], s);
-            break;
-        }
-        if (stage.delayed) {
-            break;
-        }
-    }
-
-    if (latePopulateNext) {
-        target = stage.decode[2];
-        target |= ((uint32_t) stage.decode[3]) << 16;
-
-        stage.nextInstructionPointer = target;
-        stage.altInstructionPointer = target;
-    }
-
-    stageRegisters[1] = stage;
 }
 
 void N16R::executeStage() {
     if (halted) {
-        machine->debug(7, "Execute is halted.");
+        SYSNP_DEBUG(machine, 7, "Execute is halted.");
         return;
     }
-    if (stageRegisters[2].bubble) {
-        machine->debug(7, "Execute is bubble.");
+    if (stageAt(2).bubble) {
+        SYSNP_DEBUG(machine, 7, "Execute is bubble.");
         return;
     }
-    if (stageRegisters[2].exception) {
-        machine->debug(7, "Execute is exception.");
+    if (stageAt(2).exception) {
+        SYSNP_DEBUG(machine, 7, "Execute is exception.");
         return;
     }
 
-    auto stage = stageRegisters[2];
+    auto &stage = stageAt(2);
+
+    if (executeOperation(stage.executeOp, stage.executeCanOverflow, stage.decode, stage.execute)) {
+        stage.exception = true;
+        stage.exceptionType = ExceptOverflow;
+    }
+}
+
+// Returns whether the operation overflowed.
+bool N16R::executeOperation(ExecuteOp op, CanOverflow canOverflow, const uint16_t *operands, uint16_t *result) {
+    bool overflow = false;
 
     uint32_t temp;
     uint32_t temp0;
@@ -777,25 +1477,25 @@ void N16R::executeStage() {
     bool aPos, bPos, cPos;
     uint32_t signCheck;
 
-    switch (stage.executeOp) {
+    switch (op) {
         case ExecuteSetLessThan:
         case ExecuteSubtract:
         case ExecuteSubtractHalf:
         case ExecuteAdd:
         case ExecuteAddHalf:
-            temp  = ((uint32_t) stage.decode[1] << 16) | stage.decode[0];
+            temp  = ((uint32_t) operands[1] << 16) | operands[0];
 
-            if (stage.executeOp == ExecuteAddHalf || stage.executeOp == ExecuteSubtractHalf) {
-                temp0 = e16s32(stage.decode[2]);
+            if (op == ExecuteAddHalf || op == ExecuteSubtractHalf) {
+                temp0 = e16s32(operands[2]);
             }
             else {
-                temp0 = ((uint32_t) stage.decode[3] << 16) | stage.decode[2];
+                temp0 = ((uint32_t) operands[3] << 16) | operands[2];
             }
 
-            if (stage.executeCanOverflow == CanOverflow32) {
+            if (canOverflow == CanOverflow32) {
                 signCheck = 0x80000000;
             }
-            else if (stage.executeCanOverflow == CanOverflow16) {
+            else if (canOverflow == CanOverflow16) {
                 signCheck = 0x8000;
             }
             else {
@@ -806,17 +1506,17 @@ void N16R::executeStage() {
             aPos = (temp  & signCheck) == 0;
             bPos = (temp0 & signCheck) == 0;
 
-            if (stage.executeOp != ExecuteAdd && stage.executeOp != ExecuteAddHalf) {
+            if (op != ExecuteAdd && op != ExecuteAddHalf) {
                 temp0 = ~temp0 + 1;
             }
             temp  = temp + temp0;
 
-            if (stage.executeOp == ExecuteSetLessThan) {
-                stage.execute[0] = (temp & 0x80000000) ? 1 : 0;
+            if (op == ExecuteSetLessThan) {
+                result[0] = (temp & 0x80000000) ? 1 : 0;
             }
             else {
-                stage.execute[0] = (temp      ) & 0xffff;
-                stage.execute[1] = (temp >> 16) & 0xffff;
+                result[0] = (temp      ) & 0xffff;
+                result[1] = (temp >> 16) & 0xffff;
             }
 
             cPos = (temp & signCheck) == 0;
@@ -824,79 +1524,78 @@ void N16R::executeStage() {
             // An overflow occurs only if we switched signs
             if (aPos != cPos) {
                 if (
-                    (bPos == aPos && (stage.executeOp == ExecuteAdd || stage.executeOp == ExecuteAddHalf)) ||
-                    (bPos != aPos &&  stage.executeOp != ExecuteAdd && stage.executeOp != ExecuteAddHalf)
+                    (bPos == aPos && (op == ExecuteAdd || op == ExecuteAddHalf)) ||
+                    (bPos != aPos &&  op != ExecuteAdd && op != ExecuteAddHalf)
                 ) {
-                    stage.exception = true;
-                    stage.exceptionType = ExceptOverflow;
+                    overflow = true;
                 }
             }
             
             break;
         case ExecuteAnd:
-            stage.execute[0] = stage.decode[0] & stage.decode[2];
+            result[0] = operands[0] & operands[2];
             break;
         case ExecuteOr:
-            stage.execute[0] = stage.decode[0] | stage.decode[2];
+            result[0] = operands[0] | operands[2];
             break;
         case ExecuteNor:
-            stage.execute[0] = ~(stage.decode[0] | stage.decode[2]);
+            result[0] = ~(operands[0] | operands[2]);
             break;
         case ExecuteXor:
-            stage.execute[0] = stage.decode[0] ^ stage.decode[2];
+            result[0] = operands[0] ^ operands[2];
             break;
         case ExecuteLoadUpperImmediate:
-            stage.execute[0] = stage.decode[2] << 8;
+            result[0] = operands[2] << 8;
             break;
         case ExecuteLoadLowerImmediate:
-            stage.execute[0] = stage.decode[2] & 0xff;
+            result[0] = operands[2] & 0xff;
             break;
         case ExecuteLeftShift:
-            stage.execute[0] = stage.decode[0] << ((stage.decode[2] & 0xf) + 1);
+            result[0] = operands[0] << ((operands[2] & 0xf) + 1);
             break;
         case ExecuteRightShiftArithmetic:
-            temp = e16s32(stage.decode[0]);
-            stage.execute[0] = (temp >> ((stage.decode[2] & 0xf) + 1)) & 0xffff;
+            temp = e16s32(operands[0]);
+            result[0] = (temp >> ((operands[2] & 0xf) + 1)) & 0xffff;
             break;
         case ExecuteRightShift:
-            stage.execute[0] = stage.decode[0] >> ((stage.decode[2] & 0xf) + 1);
+            result[0] = operands[0] >> ((operands[2] & 0xf) + 1);
             break;
         case ExecuteExchange:
-            stage.execute[2] = stage.decode[0];
-            stage.execute[3] = stage.decode[1];
+            result[2] = operands[0];
+            result[3] = operands[1];
             // fall through
         case ExecutePickB:
-            stage.execute[0] = stage.decode[2];
-            stage.execute[1] = stage.decode[3];
+            result[0] = operands[2];
+            result[1] = operands[3];
             break;
         case ExecuteNop: // just pass it all through
-            stage.execute[0] = stage.decode[0];
-            stage.execute[1] = stage.decode[1];
-            stage.execute[2] = stage.decode[2];
-            stage.execute[3] = stage.decode[3];
-            stage.execute[4] = stage.decode[4];
+            result[0] = operands[0];
+            result[1] = operands[1];
+            result[2] = operands[2];
+            result[3] = operands[3];
+            result[4] = operands[4];
         default:
             break;
     }
 
-    stageRegisters[2] = stage;
+    return overflow;
 }
 
 void N16R::memoryStage() {
     if (halted) {
-        machine->debug(7, "Memory is halted.");
+        SYSNP_DEBUG(machine, 7, "Memory is halted.");
         return;
     }
-    if (stageRegisters[3].bubble) {
-        machine->debug(7, "Memory is bubble.");
+    if (stageAt(3).bubble) {
+        SYSNP_DEBUG(machine, 7, "Memory is bubble.");
         return;
     }
-    if (stageRegisters[3].exception) {
-        machine->debug(7, "Memory is exception.");
+    if (stageAt(3).exception) {
+        SYSNP_DEBUG(machine, 7, "Memory is exception.");
         return;
     }
 
-    auto stage = stageRegisters[3];
+    auto &stage = stageAt(3);
 
     if (stage.memoryOp == MemoryNop) {
         return;
@@ -921,10 +1620,15 @@ void N16R::memoryStage() {
         stage.exception = true;
         stage.exceptionAddress = memoryAddress;
 
-        stageRegisters[3] = stage;
         return;
     }
 
+    // a retried access was already checked on its first attempt
+    if (!stage.delayed && breakpoints.isWatched(memoryAddress, stage.memoryBytes,
+                                                 stage.memoryOp == MemoryRead ? WatchRead : WatchWrite)) {
+        watchpointWasHit = true;
+    }
+
     if (stage.memoryOp == MemoryRead) {
         switch (memCheck.result) {
             case MemoryCheckContainsLower:
@@ -963,26 +1667,7 @@ void N16R::memoryStage() {
         }
     }
     else {
-        uint16_t memoryValue0 = stage.decode[3];
-        uint16_t memoryValue1 = stage.decode[4];
-
-        MemoryOperation writeOp;
-        writeOp.inAddress = memoryAddress;
-        writeOp.outAddress = memoryAddress;
-        writeOp.asid = asid;
-        writeOp.type = MemoryOpDataWrite;
-
-        writeOp.data.push_back(memoryValue0 & 0xff);
-        writeOp.bytes = stage.memoryBytes;
-        if (stage.memoryBytes > 1) {
-            writeOp.data.push_back(memoryValue0 >> 8);
-
-            if (stage.memoryBytes > 2) {
-                writeOp.data.push_back(memoryValue1 & 0xff);
-                writeOp.data.push_back(memoryValue1 >> 8);
-            }
-        }
-        uint16_t pendingOpId = memoryUnit.queueOperation(writeOp);
+        uint16_t pendingOpId = memoryUnit.queueOperation(writeOperation(memoryAddress, stage.memoryBytes, stage.decode + 3, asid));
         if (pendingOpId == MemoryOperation::invalidOperationId) {
             stage.delayed = true;
         }
@@ -991,17 +1676,36 @@ void N16R::memoryStage() {
             stage.memory[0] = pendingOpId;
         }
     }
+}
 
-    stageRegisters[3] = stage;
+MemoryOperation N16R::writeOperation(uint32_t address, uint8_t bytes, const uint16_t *values, uint32_t asid) {
+    MemoryOperation writeOp;
+    writeOp.inAddress = address;
+    writeOp.outAddress = address;
+    writeOp.asid = asid;
+    writeOp.type = MemoryOpDataWrite;
+
+    writeOp.data.push_back(values[0] & 0xff);
+    writeOp.bytes = bytes;
+    if (bytes > 1) {
+        writeOp.data.push_back(values[0] >> 8);
+
+        if (bytes > 2) {
+            writeOp.data.push_back(values[1] & 0xff);
+            writeOp.data.push_back(values[1] >> 8);
+        }
+    }
+
+    return writeOp;
 }
 
 void N16R::writeBackStage() {
-    if (stageRegisters[4].bubble) {
-        machine->debug(7, "Write back is bubble.");
+    if (stageAt(4).bubble) {
+        SYSNP_DEBUG(machine, 7, "Write back is bubble.");
         return;
     }
 
-    auto stage = stageRegisters[4];
+    auto &stage = stageAt(4);
 
     // if we're halted, we always accept interrupts.
     // if we aren't, we honor the code
@@ -1010,6 +1714,11 @@ void N16R::writeBackStage() {
         stage.exceptionType = ExceptInterrupt;
         halted = false;
     }
+    else if (halted) {
+        // what follows a halt into write back doesn't retire
+        stage.bubble = true;
+        return;
+    }
     else if (stage.privileged && !isKernel()) {
         stage.exception = true;
         if (stage.privilegedInstruction) {
@@ -1026,10 +1735,6 @@ void N16R::writeBackStage() {
         }
     }
 
-    if (halted) {
-        return;
-    }
-
     if (stage.commitOp == CommitSyscall) {
         stage.exception = true;
         stage.exceptionType = ExceptSyscall;
@@ -1041,7 +1746,6 @@ void N16R::writeBackStage() {
         //ipc |= (registerFile[ipcRegister + 1] << 16);
         stage.nextInstructionPointer = ipc;
         stage.altInstructionPointer = ipc;
-        stageRegisters[4] = stage;
 
         uint16_t cause  = registerFile[causeRegister ];
         uint16_t status = registerFile[statusRegister];
@@ -1073,11 +1777,6 @@ void N16R::writeBackStage() {
     bool taken = false;
     bool explicitFlush = false;
 
-    auto checkValue = stage.execute[0];
-
-    bool zero     =  checkValue == 0;
-    bool negative = (checkValue & 0x8000) != 0;
-
     switch (stage.commitOp) {
         case CommitNop:
             return;
@@ -1098,19 +1797,7 @@ void N16R::writeBackStage() {
             taken = true;
             break;
         case CommitWriteBack:
-            {
-                int i = 0;
-                for (; i < 5; i++) {
-                    if (stage.dstRegs[i] != StageRegister::emptyRegister) {
-                        registerFile[stage.dstRegs[i]] = stage.execute[i];
-                    }
-                }
-                for (; i < 7; i++) {
-                    if (stage.dstRegs[i] != StageRegister::emptyRegister) {
-                        registerFile[stage.dstRegs[i]] = stage.memory[i - 5];
-                    }
-                }
-            }
+            writeRegisters(stage.dstRegs, stage.execute, stage.memory);
             break;
         case CommitWrite:
             memoryUnit.commitOperation(stage.memory[0]);
@@ -1141,22 +1828,12 @@ void N16R::writeBackStage() {
             break;
 
         case CommitDecideEQ:
-            taken = zero;
-            break;
         case CommitDecideNE:
-            taken = !zero;
-            break;
         case CommitDecideGT:
-            taken = !zero && !negative;
-            break;
         case CommitDecideLE:
-            taken = zero || negative;
-            break;
         case CommitDecideLT:
-            taken = negative;
-            break;
         case CommitDecideGE:
-            taken = !negative;
+            taken = isBranchTaken(stage.commitOp, stage.execute[0]);
             break;
         default:
             break;
@@ -1167,62 +1844,103 @@ void N16R::writeBackStage() {
     if (taken || explicitFlush) {
         stageFlush(4);
     }
+}
 
-    stageRegisters[4] = stage;
+void N16R::writeRegisters(const uint8_t *dstRegs, const uint16_t *execute, const uint16_t *memory) {
+    int i = 0;
+    for (; i < 5; i++) {
+        if (dstRegs[i] != StageRegister::emptyRegister) {
+            registerFile[dstRegs[i]] = execute[i];
+        }
+    }
+    for (; i < 7; i++) {
+        if (dstRegs[i] != StageRegister::emptyRegister) {
+            registerFile[dstRegs[i]] = memory[i - 5];
+        }
+    }
+}
+
+bool N16R::isBranchTaken(CommitOp op, uint16_t checkValue) {
+    bool zero     =  checkValue == 0;
+    bool negative = (checkValue & 0x8000) != 0;
+
+    switch (op) {
+        case CommitJump:
+            return true;
+        case CommitDecideEQ:
+            return zero;
+        case CommitDecideNE:
+            return !zero;
+        case CommitDecideGT:
+            return !zero && !negative;
+        case CommitDecideLE:
+            return zero || negative;
+        case CommitDecideLT:
+            return negative;
+        case CommitDecideGE:
+            return !negative;
+        default:
+            return false;
+    }
 }
 
 void N16R::stageFlush(int until) {
     for (int i = 0; i < 5 && i < until; i++) {
-        stageRegisters[i].invalidate();
-        if (i >= 3 && stageRegisters[i].commitOp == CommitWrite) {
-            memoryUnit.invalidateOperation(stageRegisters[i].memory[0]);
+        auto &stage = stageAt(i);
+        stage.invalidate();
+        if (i >= 3 && stage.commitOp == CommitWrite) {
+            memoryUnit.invalidateOperation(stage.memory[0]);
         }
     }
 }
 
 void N16R::stageShift() {
-    auto justRetired = stageRegisters.back();
+    auto &retiring = stageAt(4);
+    bool retiredException = retiring.exception;
+    bool retiredTaken = retiring.taken;
+    uint32_t retiredAltPointer = retiring.altInstructionPointer;
 
-    if (!justRetired.bubble) {
-        retiredAddresses.push_back(justRetired.instructionPointer);
+    if (!retiring.bubble) {
+        retiredAddresses.push_back(retiring.instructionPointer);
         retiredCount++;
     }
 
-    stageRegisters[4].invalidate();
+    retiring.invalidate();
 
-    for (int i = stageRegisters.size() - 2; i >= 0; i--) {
-        // check if we can progress forward
-        if (stageRegisters[i+1].bubble) {
-            // and check if we're delayed
-            if (!stageRegisters[i].delayed) {
-                stageRegisters[i+1] = stageRegisters[i];
-                stageRegisters[i].invalidate();
-            }
-        }
+    bool stalled = false;
+    for (int i = 0; i < pipelineDepth - 1; i++) {
+        stalled = stalled || stageAt(i).delayed;
     }
 
-    registerHazards.clear();
-
-    for (auto stage: stageRegisters) {
-        if (!stage.bubble) {
-            for (int i = 0; i < 5; i++) {
-                if (stage.dstRegs[i] != StageRegister::emptyRegister) {
-                    registerHazards.insert(stage.dstRegs[i]);
+    if (!stalled) {
+        // everything moves up one stage; the retired slot becomes stage 0
+        stageHead = (stageHead + pipelineDepth - 1) % pipelineDepth;
+    }
+    else {
+        for (int i = pipelineDepth - 2; i >= 0; i--) {
+            // check if we can progress forward
+            if (stageAt(i+1).bubble) {
+                // and check if we're delayed
+                if (!stageAt(i).delayed) {
+                    stageAt(i+1) = stageAt(i);
+                    stageAt(i).invalidate();
                 }
             }
         }
     }
 
-    if (stageRegisters[0].bubble || justRetired.exception) {
+    updateScoreboard();
+
+    if (stageAt(0).bubble || retiredException) {
         StageRegister nextStart;
 
-        if (justRetired.exception || justRetired.taken) {
-            nextStart.instructionPointer = justRetired.altInstructionPointer;
+        if (retiredException || retiredTaken) {
+            nextStart.instructionPointer = retiredAltPointer;
         }
         else {
-            for (auto stage: stageRegisters) {
-                if (!stage.bubble) {
-                    nextStart.instructionPointer = stage.nextInstructionPointer;
+            for (int i = 0; i < pipelineDepth; i++) {
+                if (!stageAt(i).bubble) {
+                    nextStart.instructionPointer = stageAt(i).nextInstructionPointer;
                     break;
                 }
             }
@@ -1231,13 +1949,26 @@ void N16R::stageShift() {
         nextStart.altInstructionPointer  = 0xdeadbeef;
         nextStart.bubble = false;
 
-        stageRegisters[0] = nextStart;
+        stageAt(0) = nextStart;
     }
 }
 
-void N16R::stageClearOut() {
-    for (int i = 0; i < 5; i++) {
-        stageRegistersOut[i].invalidate();
+void N16R::updateScoreboard() {
+    scoreboard = 0;
+    for (int s = 0; s < pipelineDepth; s++) {
+        auto &stage = stageAt(s);
+        executeWrites[s] = 0;
+        memoryWrites[s] = 0;
+        // only what is past decode can hold up an operand
+        if (s < 2 || stage.bubble) {
+            continue;
+        }
+        for (int i = 0; i < 7; i++) {
+            if (stage.dstRegs[i] != StageRegister::emptyRegister) {
+                (i < 5 ? executeWrites : memoryWrites)[s] |= 1ull << stage.dstRegs[i];
+            }
+        }
+        scoreboard |= executeWrites[s] | memoryWrites[s];
     }
 }
 
@@ -1301,8 +2032,8 @@ std::string N16R::command(std::stringstream &input) {
     }
     else if (commandWord == "pipeline") {
         response << "IP         NXIP       ALIP       PDBET   INST EXTR  X  M  C   D0   D1   D2   D3   D4    X0   X1   X2   X3   X4    M0   M1" << std::endl;
-        int sr = 0;
-        for (auto iter = stageRegisters.cbegin(); iter != stageRegisters.cend(); iter++, sr++) {
+        for (int sr = 0; sr < pipelineDepth; sr++) {
+            auto iter = &stageAt(sr);
             response << std::setw(8) << std::setfill('0') << std::hex << iter->instructionPointer << "   ";
             response << std::setw(8) << std::setfill('0') << std::hex << iter->nextInstructionPointer << "   ";
             response << std::setw(8) << std::setfill('0') << std::hex << iter->altInstructionPointer << "   ";
@@ -1326,9 +2057,9 @@ std::string N16R::command(std::stringstream &input) {
             response << "  ";
 
             if (sr > 1) {
-                response << std::setw(2) << std::setfill('0') << iter->executeOp << " ";
-                response << std::setw(2) << std::setfill('0') << iter->memoryOp << " ";
-                response << std::setw(2) << std::setfill('0') << iter->commitOp << " ";
+                response << std::setw(2) << std::setfill('0') << (int) iter->executeOp << " ";
+                response << std::setw(2) << std::setfill('0') << (int) iter->memoryOp << " ";
+                response << std::setw(2) << std::setfill('0') << (int) iter->commitOp << " ";
             }
             else {
                 response << "         ";
@@ -1412,12 +2143,67 @@ std::string N16R::command(std::stringstream &input) {
             response << std::endl;
         }
     }
+    else if (commandWord == "mode") {
+        std::string mode;
+        input >> mode;
+
+        if (mode == "functional" && isPipelined) {
+            enterFunctional();
+        }
+        else if (mode == "pipelined" && !isPipelined) {
+            // the pipeline takes over at the next instruction boundary
+            if (functionalStage == 0) {
+                isPipelined = true;
+            }
+            else {
+                switchToPipelined = true;
+            }
+        }
+        else if (mode != "" && mode != "functional" && mode != "pipelined") {
+            response << "Unknown mode " << mode << "." << std::endl;
+        }
+
+        response << "mode: " << (isPipelined || switchToPipelined ? "pipelined" : "functional") << std::endl;
+    }
+    else if (commandWord == "translate") {
+        int cached = 0;
+        for (auto &block: translatedBlocks) {
+            if (block.translated) {
+                cached++;
+            }
+        }
+        response << std::dec << "translation " << (useTranslation ? "on" : "off") << ", blocks: " << cached << ", translated: " << translatedBlockCount << ", retired: " << translatedRetired << std::endl;
+    }
     else if (commandWord == "memio") {
         response << memoryUnit.describeQueuedOperations() << std::endl;
     }
     else if (commandWord == "cache") {
         response << memoryUnit.listContents(input);
     }
+    else if (commandWord == "l2") {
+        response << memoryUnit.describeLevelTwo();
+    }
+    else if (commandWord == "writeback") {
+        response << memoryUnit.describeWriteBack();
+    }
+    else if (commandWord == "stores") {
+        response << memoryUnit.describeStoreBuffer();
+    }
+    else if (commandWord == "prefetch") {
+        response << memoryUnit.describePrefetch();
+    }
+    else if (commandWord == "fills") {
+        response << memoryUnit.describeCriticalWord();
+    }
+    else if (commandWord == "flush") {
+        // dirty lines would otherwise only reach memory over the bus
+        memoryUnit.flushCaches(true);
+        drainMemory();
+        response << memoryUnit.describeQueuedOperations() << std::endl;
+    }
+    else if (commandWord == "decode") {
+        response << std::dec << "decode cache " << (useDecodeCache ? "on" : "off") << ", hits: " << decodeCacheHits << ", misses: " << decodeCacheMisses << std::endl;
+    }
     else if (commandWord == "trace") {
         int width = 0;
         for (auto address: retiredAddresses) {
@@ -1450,19 +2236,19 @@ void N16R::reset() {
     resetVector.nextInstructionPointer = resetAddress;
     resetVector.bubble = false;
 
-    StageRegister bubble;
-    bubble.bubble = true;
+    stageHead = 0;
+    for (auto &stage: stageRing) {
+        stage = StageRegister();
+    }
+    stageAt(0) = resetVector;
+    updateScoreboard();
 
-    stageRegisters.clear();
-    stageRegistersOut.clear();
+    functionalStage = 0;
+    switchToPipelined = false;
 
-    stageRegisters.push_back(resetVector);
-    stageRegistersOut.push_back(bubble);
-
-    for (int i = 0; i < 4; i++) {
-        stageRegisters.push_back(bubble);
-        stageRegistersOut.push_back(bubble);
-    }
+    flushTranslations();
+    translatedRetired = 0;
+    translatedBlockCount = 0;
 
     registerFile[041] = 0;
     //executionBuffer.reset();
@@ -1471,25 +2257,125 @@ void N16R::reset() {
     retiredAddresses.clear();
     clockCount = 0;
     retiredCount = 0;
+    owedCycles = 0;
 }
 
-bool N16R::breakpointHit() {
-    bool wasHit = breakpointWasHit;
-    breakpointWasHit = false;
-    return wasHit;
+void N16R::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(registerFile);
+    snapshot.write(halted);
+    snapshot.write(lastBreakpoint);
+    snapshot.write(breakpointDrain);
+    snapshot.write(breakpointWasHit);
+
+    for (int i = 0; i < pipelineDepth; i++) {
+        stageAt(i).saveState(snapshot);
+    }
+    snapshot.write(isPipelined);
+    snapshot.write(functionalStage);
+    snapshot.write(switchToPipelined);
+
+    memoryUnit.saveState(snapshot);
+    busUnit.saveState(snapshot);
+
+    snapshot.write(std::vector<uint32_t>(retiredAddresses.begin(), retiredAddresses.end()));
+    snapshot.write(clockCount);
+    snapshot.write(retiredCount);
+    snapshot.write(owedCycles);
+
+    // which blocks were translated, so a restored machine runs the same way
+    snapshot.write<uint64_t>(translatedBlocks.size());
+    for (auto &block: translatedBlocks) {
+        snapshot.write(block.address);
+        snapshot.write(block.entries);
+        snapshot.write(block.translated);
+    }
+    snapshot.write(translatedRetired);
+    snapshot.write(translatedBlockCount);
+}
+void N16R::loadState(SnapshotReader &snapshot) {
+    snapshot.read(registerFile);
+    snapshot.read(halted);
+    snapshot.read(lastBreakpoint);
+    snapshot.read(breakpointDrain);
+    snapshot.read(breakpointWasHit);
+
+    stageHead = 0;
+    for (auto &stage: stageRing) {
+        stage.loadState(snapshot);
+    }
+    updateScoreboard();
+    snapshot.read(isPipelined);
+    snapshot.read(functionalStage);
+    snapshot.read(switchToPipelined);
+
+    memoryUnit.loadState(snapshot);
+    busUnit.loadState(snapshot);
+
+    std::vector<uint32_t> retired;
+    snapshot.read(retired);
+    retiredAddresses.clear();
+    for (auto address: retired) {
+        retiredAddresses.push_back(address);
+    }
+    snapshot.read(clockCount);
+    snapshot.read(retiredCount);
+    snapshot.read(owedCycles);
+
+    flushTranslations();
+    uint64_t blockCount = snapshot.read<uint64_t>();
+    for (uint64_t i = 0; i < blockCount; i++) {
+        TranslatedBlock block;
+        snapshot.read(block.address);
+        snapshot.read(block.entries);
+        snapshot.read(block.translated);
+        if (i < translatedBlocks.size()) {
+            translatedBlocks[i] = block;
+            if (block.translated) {
+                translateBlock(translatedBlocks[i]);
+            }
+        }
+    }
+    snapshot.read(translatedRetired);
+    snapshot.read(translatedBlockCount);
 }
+void N16R::saveGeometry(SnapshotWriter &snapshot) {
+    snapshot.write<uint64_t>(pipelineDepth);
+    memoryUnit.saveGeometry(snapshot);
+}
+
 void N16R::breakpointClear() {
     breakpoints.clear();
+    flushTranslations();
 }
 void N16R::breakpointAdd(uint32_t addr) {
-    if (!breakpoints.contains(addr)) {
-        breakpoints.insert(addr);
-    }
+    Breakpoint breakpoint;
+    breakpoint.address = addr;
+    breakpoints.add(breakpoint);
+    flushTranslations();
 }
 void N16R::breakpointRemove(uint32_t addr) {
-    auto location = breakpoints.find(addr);
-    if (location != breakpoints.end()) {
-        breakpoints.erase(location);
+    breakpoints.remove(addr);
+}
+std::string N16R::breakpointCommand(std::stringstream &input) {
+    std::string response = breakpoints.command(input);
+    // translated blocks end at the breakpoints they were translated with
+    flushTranslations();
+    return response;
+}
+
+DecodedInstruction::DecodedInstruction():
+        address(0), valid(false), instruction(0), extension(0), usesExtension(false),
+        executeOp(ExecuteNop), memoryOp(MemoryNop), commitOp(CommitNop), executeCanOverflow(CanNotOverflow),
+        memoryBytes(0), setsMemoryOp(false), setsMemoryBytes(false),
+        linkOffset(0), linkMask(0), hasBranchOffset(false), branchOffset(0),
+        clearsExceptionType(false), invalid(false), privileged(false), jumpToRegister(false) {
+    for (int i = 0; i < 5; i++) {
+        operandSource[i] = OperandKeep;
+        operandValue[i] = 0;
+        srcRegs[i] = StageRegister::emptyRegister;
+    }
+    for (int i = 0; i < 7; i++) {
+        dstRegs[i] = StageRegister::emptyRegister;
     }
 }
 
@@ -1516,30 +2402,59 @@ void StageRegister::invalidate() {
     }
 }
 
-OperandHazard StageRegister::checkOperandHazard(uint8_t reg, uint8_t stage) {
-    if (bubble) {
-        return OperandHazardNone;
-    }
-    if (stage == 2) {
-        for (int i = 0; i < 5; i++) {
-            if (reg == dstRegs[i]) {
-                return OperandHazardCurrent;
-            }
-        }
-        if (reg == dstRegs[5] || reg == dstRegs[6]) {
-            return OperandHazardNext;
-        }
-    }
-    else if (stage >= 3) {
-        for (int i = 0; i < 7; i++) {
-            if (reg == dstRegs[i]) {
-                return delayed ? OperandHazardNext : OperandHazardCurrent;
-            }
-        }
-    }
-
-    return OperandHazardNone;
+void StageRegister::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(instructionPointer);
+    snapshot.write(nextInstructionPointer);
+    snapshot.write(altInstructionPointer);
+    snapshot.write(fetch);
+    snapshot.write(decode);
+    snapshot.write(execute);
+    snapshot.write(memory);
+    snapshot.write(srcRegs);
+    snapshot.write(dstRegs);
+    snapshot.write(executeOp);
+    snapshot.write(memoryOp);
+    snapshot.write(commitOp);
+    snapshot.write(memoryBytes);
+    snapshot.write(executeCanOverflow);
+    snapshot.write<bool>(privileged);
+    snapshot.write<bool>(privilegedInstruction);
+    snapshot.write<bool>(privilegedRead);
+    snapshot.write<bool>(privilegedWrite);
+    snapshot.write<bool>(delayed);
+    snapshot.write<bool>(bubble);
+    snapshot.write<bool>(taken);
+    snapshot.write<bool>(exception);
+    snapshot.write(exceptionType);
+    snapshot.write(exceptionAddress);
+}
+void StageRegister::loadState(SnapshotReader &snapshot) {
+    snapshot.read(instructionPointer);
+    snapshot.read(nextInstructionPointer);
+    snapshot.read(altInstructionPointer);
+    snapshot.read(fetch);
+    snapshot.read(decode);
+    snapshot.read(execute);
+    snapshot.read(memory);
+    snapshot.read(srcRegs);
+    snapshot.read(dstRegs);
+    snapshot.read(executeOp);
+    snapshot.read(memoryOp);
+    snapshot.read(commitOp);
+    snapshot.read(memoryBytes);
+    snapshot.read(executeCanOverflow);
+    privileged = snapshot.read<bool>();
+    privilegedInstruction = snapshot.read<bool>();
+    privilegedRead = snapshot.read<bool>();
+    privilegedWrite = snapshot.read<bool>();
+    delayed = snapshot.read<bool>();
+    bubble = snapshot.read<bool>();
+    taken = snapshot.read<bool>();
+    exception = snapshot.read<bool>();
+    snapshot.read(exceptionType);
+    snapshot.read(exceptionAddress);
 }
+
 uint16_t StageRegister::operandForward(uint8_t reg, uint8_t stage) {
     for (int i = 0; i < 5; i++) {
         if (reg == dstRegs[i]) {
@@ -4,7 +4,9 @@
 #include "../nbus.h"
 #include "busunit.h"
 #include "memoryUnit.h"
+#include "breakpointUnit.h"
 #include <boost/circular_buffer.hpp>
+#include <array>
 #include <set>
 
 namespace sysnp {
@@ -13,7 +15,7 @@ namespace nbus {
 
 namespace n16r {
 
-enum ExceptionType {
+enum ExceptionType : uint8_t {
     ExceptInterrupt           = 000,
     ExceptTlbFault,
     ExceptProtFault,
@@ -30,7 +32,7 @@ enum ExceptionType {
     ExceptNone                = 077
 };
 
-enum ExecuteOp {
+enum ExecuteOp : uint8_t {
     ExecuteNop,
 
     ExecuteAdd,
@@ -50,7 +52,7 @@ enum ExecuteOp {
     ExecuteExchange,
     ExecutePickB
 };
-enum MemoryOp {
+enum MemoryOp : uint8_t {
     MemoryNop,
 
     MemoryRead,
@@ -62,7 +64,7 @@ enum MemoryOp {
     MemoryWriteWord,
     MemoryWriteDword
 };
-enum CommitOp {
+enum CommitOp : uint8_t {
     CommitNop,
 
     CommitWriteBack,
@@ -87,28 +89,24 @@ enum CommitOp {
     CommitExceptionReturn,
     CommitExceptionReturnJump
 };
-enum OperandHazard {
-    OperandHazardNone,
-    OperandHazardCurrent,
-    OperandHazardNext
-};
-
-enum CanOverflow {
+enum CanOverflow : uint8_t {
     CanNotOverflow,
     CanOverflow16,
     CanOverflow32
 };
 
-class StageRegister {
+// Everything one instruction carries between stages, packed into a single
+// cache line.
+class alignas(64) StageRegister {
     public:
         StageRegister();
-        virtual ~StageRegister() {}
 
         void invalidate();
 
         uint32_t instructionPointer;
         uint32_t nextInstructionPointer;
         uint32_t altInstructionPointer;
+        uint32_t exceptionAddress;
 
         uint16_t fetch  [2];
         uint16_t decode [5];
@@ -117,8 +115,6 @@ class StageRegister {
         uint8_t  srcRegs[5];
         uint8_t  dstRegs[7];
 
-        uint32_t getQWord(int, uint16_t*);
-
         ExecuteOp executeOp;
         MemoryOp  memoryOp;
         CommitOp  commitOp;
@@ -126,26 +122,107 @@ class StageRegister {
         uint8_t memoryBytes;
 
         CanOverflow executeCanOverflow;
-
-        bool flushOnCommit;
-
-        bool privileged;
-        bool privilegedInstruction;
-        bool privilegedRead;
-        bool privilegedWrite;
-        bool delayed;
-        bool bubble;
-        bool taken;
-
-        bool exception;
         ExceptionType exceptionType;
-        uint32_t exceptionAddress;
 
-        OperandHazard checkOperandHazard(uint8_t, uint8_t);
+        bool privileged            : 1;
+        bool privilegedInstruction : 1;
+        bool privilegedRead        : 1;
+        bool privilegedWrite       : 1;
+        bool delayed               : 1;
+        bool bubble                : 1;
+        bool taken                 : 1;
+        bool exception             : 1;
+
         uint16_t operandForward(uint8_t, uint8_t);
 
+        void saveState(SnapshotWriter&);
+        void loadState(SnapshotReader&);
+
         const static uint8_t emptyRegister = 255;
 };
+static_assert(sizeof(StageRegister) == 64);
+
+enum OperandSource : uint8_t {
+    OperandKeep,
+    OperandImmediate,
+    OperandRegister,
+    OperandLinkLow,
+    OperandLinkHigh
+};
+
+// What decode derives from the instruction words alone. Register values and
+// instruction-pointer-relative fields are filled in each time the record is
+// applied to a stage, so one record serves every pass through a loop.
+struct DecodedInstruction {
+    DecodedInstruction();
+
+    uint32_t address;
+    bool valid;
+
+    uint16_t instruction;
+    uint16_t extension;
+    bool usesExtension;
+
+    ExecuteOp executeOp;
+    MemoryOp  memoryOp;
+    CommitOp  commitOp;
+    CanOverflow executeCanOverflow;
+    uint8_t memoryBytes;
+    bool setsMemoryOp;
+    bool setsMemoryBytes;
+
+    OperandSource operandSource[5];
+    uint16_t      operandValue [5];
+    uint8_t       srcRegs[5];
+    uint8_t       dstRegs[7];
+
+    uint16_t linkOffset;
+    uint16_t linkMask;
+    bool     hasBranchOffset;
+    uint32_t branchOffset;
+
+    bool clearsExceptionType;
+    bool invalid;
+    bool privileged;
+    bool jumpToRegister;
+
+    void setRegister (int operand, uint8_t reg)    { operandSource[operand] = OperandRegister;  operandValue[operand] = reg; }
+    void setImmediate(int operand, uint16_t value) { operandSource[operand] = OperandImmediate; operandValue[operand] = value; }
+    void setLink(uint16_t offset, uint16_t mask) {
+        operandSource[0] = OperandLinkLow;
+        operandSource[1] = OperandLinkHigh;
+        linkOffset = offset;
+        linkMask = mask;
+    }
+    void setMemoryOp(MemoryOp op)     { memoryOp = op; setsMemoryOp = true; }
+    void setMemoryBytes(uint8_t bytes) { memoryBytes = bytes; setsMemoryBytes = true; }
+};
+
+class N16R;
+
+// An instruction of a translated block. The handler is picked once, when the
+// block is translated, from what the instruction commits.
+struct TranslatedInstruction {
+    TranslatedInstruction(): address(0), nextAddress(0), handler(nullptr) {}
+
+    DecodedInstruction decoded;
+    uint32_t address;
+    uint32_t nextAddress;
+    bool (N16R::*handler)(const TranslatedInstruction&, uint32_t&);
+};
+
+// A straight run of code ending at the first instruction that can change the
+// flow of control, translated to threaded code once it has been entered often
+// enough.
+struct TranslatedBlock {
+    TranslatedBlock(): address(0), entries(0), translated(false), privileged(false) {}
+
+    uint32_t address;
+    uint32_t entries;
+    bool translated;
+    bool privileged;
+    std::vector<TranslatedInstruction> instructions;
+};
 
 class N16R : public NBusDevice {
     public:
@@ -157,15 +234,36 @@ class N16R : public NBusDevice {
         virtual void clockUp();
         virtual void clockDown();
 
+        virtual uint64_t nextEvent();
+        virtual void skipCycles(uint64_t);
+
+        virtual void saveState(SnapshotWriter&);
+        virtual void loadState(SnapshotReader&);
+        virtual void saveGeometry(SnapshotWriter&);
+
         virtual std::string command(std::stringstream&);
 
-        // breakpoints
-        virtual void breakpointClear();
-        virtual void breakpointAdd(uint32_t);
-        virtual void breakpointRemove(uint32_t);
-        virtual bool breakpointHit();
+        // breakpoints and watchpoints
+        void breakpointClear();
+        void breakpointAdd(uint32_t);
+        void breakpointRemove(uint32_t);
+        std::string breakpointCommand(std::stringstream&);
+        bool breakpointHit() {
+            bool wasHit = breakpointWasHit || watchpointWasHit;
+            breakpointWasHit = false;
+            watchpointWasHit = false;
+            return wasHit;
+        }
+
+        // run statistics
+        bool isHalted() { return halted; }
+        bool isMemoryIdle() { return busUnit.isIdle() && !busUnit.hasData() && !memoryUnit.isOperationPending(); }
+        uint64_t getClockCount() { return clockCount; }
+        uint64_t getRetiredCount() { return retiredCount; }
+        uint32_t getRetiredAddress() { return retiredAddresses.empty() ? 0 : retiredAddresses.back(); }
     private:
         uint16_t registerFile[48];
+        static_assert(sizeof(registerFile) / sizeof(registerFile[0]) <= 64, "register masks are 64 bits wide");
 
         const static uint8_t causeRegister = 32;
         const static uint8_t statusRegister = 33;
@@ -180,23 +278,79 @@ class N16R : public NBusDevice {
         uint16_t getWord (int, uint16_t*);
         uint32_t getDWord(int, uint16_t*);
 
-        std::vector<StageRegister> stageRegisters;
-        std::vector<StageRegister> stageRegistersOut;
-        std::set<uint8_t> registerHazards;
+        // stage n lives at stageRing[(stageHead + n) % pipelineDepth]
+        const static int pipelineDepth = 5;
+        std::array<StageRegister, pipelineDepth> stageRing;
+        int stageHead;
+        StageRegister &stageAt(int n) { return stageRing[(stageHead + n) % pipelineDepth]; }
+
+        // registers the stages past decode will write, one bit per register:
+        // from execute results and from memory, by stage, and all of them
+        std::array<uint64_t, pipelineDepth> executeWrites;
+        std::array<uint64_t, pipelineDepth> memoryWrites;
+        uint64_t scoreboard;
+        void updateScoreboard();
 
         void fetchStage();
         void decodeStage();
+        static void decodeInstruction(uint16_t, uint16_t, DecodedInstruction&);
+        void readOperands(const DecodedInstruction&, uint32_t, uint16_t*);
         void executeStage();
+        static bool executeOperation(ExecuteOp, CanOverflow, const uint16_t*, uint16_t*);
+        static bool isBranchTaken(CommitOp, uint16_t);
+        static MemoryOperation writeOperation(uint32_t, uint8_t, const uint16_t*, uint32_t);
+        void writeRegisters(const uint8_t*, const uint16_t*, const uint16_t*);
         void memoryStage();
         void writeBackStage();
 
         void stageFlush(int);
         void stageShift();
-        void stageClearOut();
+        bool isPipelineSettled();
+        bool isPipelineDrained();
+        bool isWaitingOnFetch();
+
+        void drainMemory();
+
+        // functional mode: one instruction at a time through the stages
+        const static int functionalFlushCost = 4;
+        int functionalStage;
+        bool switchToPipelined;
+        void functionalStep();
+        void functionalAdvance(int);
+        void functionalRetire();
+        void enterFunctional();
+
+        // block translation, used by the functional mode
+        const static int translateThreshold = 16;
+        const static int translateBlockLimit = 32;
+        const static int translateRunLimit = 256;
+        const static int translateCacheBits = 8;
+        std::vector<TranslatedBlock> translatedBlocks;
+        bool useTranslation;
+        uint32_t translatedGeneration;
+        uint64_t translatedRetired;
+        uint64_t translatedBlockCount;
+        void flushTranslations();
+        void translateBlock(TranslatedBlock&);
+        int runTranslated();
+        // bus cycles a translated run has already used; the core sits them
+        // out while the rest of the machine catches up
+        uint64_t owedCycles;
+        bool translatedOperation(const TranslatedInstruction&, uint32_t&);
+        bool translatedLoad     (const TranslatedInstruction&, uint32_t&);
+        bool translatedStore    (const TranslatedInstruction&, uint32_t&);
+        bool translatedBranch   (const TranslatedInstruction&, uint32_t&);
 
         MemoryUnit memoryUnit;
         BusUnit    busUnit;
 
+        // decoded instructions, direct-mapped by instruction address
+        const static int decodeCacheBits = 10;
+        std::vector<DecodedInstruction> decodeCache;
+        bool useDecodeCache;
+        uint64_t decodeCacheHits;
+        uint64_t decodeCacheMisses;
+
         uint32_t resetAddress;
         bool isPipelined;
 
@@ -207,10 +361,14 @@ class N16R : public NBusDevice {
 
         void reset();
 
-        // breakpoints
+        // breakpoints and watchpoints
         uint32_t lastBreakpoint;
         bool breakpointWasHit;
-        std::set<uint32_t> breakpoints;
+        bool watchpointWasHit;
+        // fetch is held in front of a conditional breakpoint until the
+        // instructions ahead of it have written back
+        bool breakpointDrain;
+        BreakpointUnit breakpoints;
 
         boost::circular_buffer<uint32_t> retiredAddresses;
         uint64_t clockCount;
@@ -0,0 +1,188 @@
+#ifndef SYSNP_REPLACEMENT_H
+#define SYSNP_REPLACEMENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <bit>
+
+#include "../../snapshot.h"
+
+namespace sysnp {
+
+namespace nbus {
+
+namespace n16r {
+
+enum ReplacementPolicy {
+    ReplaceLru,
+    ReplaceTreePlru,
+    ReplaceRandom,
+    ReplaceFifo,
+    ReplaceSrrip
+};
+
+inline ReplacementPolicy parseReplacementPolicy(const std::string &name) {
+    if (name == "lru"   ) return ReplaceLru;
+    if (name == "plru"  ) return ReplaceTreePlru;
+    if (name == "random") return ReplaceRandom;
+    if (name == "fifo"  ) return ReplaceFifo;
+    if (name == "srrip" ) return ReplaceSrrip;
+    throw std::invalid_argument("Unknown cache replacement policy \"" + name + "\"");
+}
+
+// Replacement policies for Cache. Each keeps stateBytes(ways) bytes of state
+// per set, zeroed when the cache is built. touch() is called on a hit,
+// insert() when a line is filled, and victim() picks the way to refill once
+// every way of the set is present.
+
+// True LRU: an age per way, the most recently used at ways - 1.
+struct LruPolicy {
+    static size_t stateBytes(int ways) { return ways; }
+
+    void touch(uint8_t *state, int ways, int way) {
+        uint8_t oldAge = state[way];
+        for (int w = 0; w < ways; w++) {
+            if (w == way) {
+                state[w] = ways - 1;
+            }
+            else if (state[w] > oldAge) {
+                state[w] -= 1;
+            }
+        }
+    }
+    void insert(uint8_t *state, int ways, int way) { touch(state, ways, way); }
+    int victim(uint8_t *state, int ways) {
+        for (int w = 0; w < ways; w++) {
+            if (state[w] == 0) {
+                return w;
+            }
+        }
+        return 0;
+    }
+
+    void saveState(SnapshotWriter&) {}
+    void loadState(SnapshotReader&) {}
+};
+
+// Tree pseudo-LRU: one bit per node of a binary tree over the ways, each
+// pointing at the half to replace next.
+struct TreePlruPolicy {
+    static size_t stateBytes(int) { return sizeof(uint32_t); }
+
+    void touch(uint8_t *state, int ways, int way) {
+        uint32_t tree = load(state);
+        for (int node = way + ways; node > 1; node >>= 1) {
+            if (node & 1) {
+                tree &= ~(1u << (node >> 1));
+            }
+            else {
+                tree |= 1u << (node >> 1);
+            }
+        }
+        std::memcpy(state, &tree, sizeof(tree));
+    }
+    void insert(uint8_t *state, int ways, int way) { touch(state, ways, way); }
+    int victim(uint8_t *state, int ways) {
+        uint32_t tree = load(state);
+        int node = 1;
+        while (node < ways) {
+            node = (node << 1) | ((tree >> node) & 1);
+        }
+        return node - ways;
+    }
+
+    void saveState(SnapshotWriter&) {}
+    void loadState(SnapshotReader&) {}
+
+    private:
+        static uint32_t load(const uint8_t *state) {
+            uint32_t tree;
+            std::memcpy(&tree, state, sizeof(tree));
+            return tree;
+        }
+};
+
+// Random replacement from a fixed-seed xorshift, so runs repeat.
+struct RandomPolicy {
+    static size_t stateBytes(int) { return 0; }
+
+    void touch(uint8_t*, int, int) {}
+    void insert(uint8_t*, int, int) {}
+    int victim(uint8_t*, int ways) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed & (ways - 1);
+    }
+
+    void saveState(SnapshotWriter &snapshot) { snapshot.write(seed); }
+    void loadState(SnapshotReader &snapshot) { snapshot.read(seed); }
+
+    uint32_t seed = 0x9e3779b9;
+};
+
+// First in, first out: the way after the last one filled goes next.
+struct FifoPolicy {
+    static size_t stateBytes(int) { return 1; }
+
+    void touch(uint8_t*, int, int) {}
+    void insert(uint8_t *state, int ways, int way) { state[0] = (way + 1) & (ways - 1); }
+    int victim(uint8_t *state, int) { return state[0]; }
+
+    void saveState(SnapshotWriter&) {}
+    void loadState(SnapshotReader&) {}
+};
+
+// Static re-reference interval prediction: a 2-bit prediction per way,
+// packed into one 64-bit word. Hits predict a near re-reference, fills a
+// long one, and the victim is the first way predicted distant, ageing the
+// whole set until there is one.
+struct SrripPolicy {
+    static size_t stateBytes(int) { return sizeof(uint64_t); }
+
+    const static uint64_t inserted = 2;
+
+    void touch(uint8_t *state, int, int way) { set(state, way, 0); }
+    void insert(uint8_t *state, int, int way) { set(state, way, inserted); }
+    int victim(uint8_t *state, int ways) {
+        uint64_t values = load(state);
+        uint64_t used = ways == 32 ? ~0ull : (1ull << (ways * 2)) - 1;
+        uint64_t low = 0x5555555555555555ull & used;
+        while (true) {
+            // ways whose two bits are both set
+            uint64_t found = values & (values >> 1) & low;
+            if (found) {
+                return std::countr_zero(found) / 2;
+            }
+            // none are at distant, so every way can age by one
+            values += low;
+            std::memcpy(state, &values, sizeof(values));
+        }
+    }
+
+    void saveState(SnapshotWriter&) {}
+    void loadState(SnapshotReader&) {}
+
+    private:
+        static uint64_t load(const uint8_t *state) {
+            uint64_t values;
+            std::memcpy(&values, state, sizeof(values));
+            return values;
+        }
+        static void set(uint8_t *state, int way, uint64_t value) {
+            uint64_t values = load(state);
+            values = (values & ~(3ull << (way * 2))) | (value << (way * 2));
+            std::memcpy(state, &values, sizeof(values));
+        }
+};
+
+}; // namespace n16r
+
+}; // namespace nbus
+
+}; // namespace sysnp
+
+#endif
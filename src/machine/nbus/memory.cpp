@@ -1,7 +1,15 @@
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <array>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "memory.h"
 
@@ -31,7 +39,8 @@ void Memory::init(ryml::NodeRef &setting) {
         moduleConfig["name" ] >> name;
         moduleConfig["size" ] >> size;
         moduleConfig["rom"  ] >> rom;
-        if (rom) {
+        file.clear();
+        if (moduleConfig.has_child("file")) {
             moduleConfig["file"] >> file;
         }
         moduleConfig["readLatency"] >> readLatency;
@@ -47,23 +56,54 @@ void Memory::init(ryml::NodeRef &setting) {
         }
     }
 
+    buildDecoder();
+
     machine->debug("Memory::init()");
     machine->debug(" Found " + std::to_string(moduleCount) + " modules for " + std::to_string(ramCapacity) + "KB RAM, " + std::to_string(romCapacity) + "KB ROM");
 }
 
+void Memory::buildDecoder() {
+    ranges.clear();
+    for (auto &module: modules) {
+        ranges.push_back({module->getStartAddress(), module->getStartAddress() + module->getSize(), module.get()});
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const MemoryRange &a, const MemoryRange &b) {
+        return a.start < b.start;
+    });
+
+    for (int i = 1; i < ranges.size(); i++) {
+        if (ranges[i].start < ranges[i - 1].end) {
+            throw std::invalid_argument("Memory modules \"" + ranges[i - 1].module->getName() + "\" and \"" + ranges[i].module->getName() + "\" overlap");
+        }
+    }
+
+    pageMap.fill(pageUnmapped);
+    for (int i = 0; i < ranges.size(); i++) {
+        if (ranges[i].end <= ranges[i].start) {
+            continue;
+        }
+        uint32_t first = ranges[i].start >> pageBits;
+        uint32_t last  = (ranges[i].end - 1) >> pageBits;
+        for (uint32_t page = first; page <= last && page < pageCount; page++) {
+            bool whole = ranges[i].start <= (page << pageBits) && ranges[i].end >= ((page + 1) << pageBits);
+            pageMap[page] = (whole && pageMap[page] == pageUnmapped) ? i : pageSplit;
+        }
+    }
+}
+
 void Memory::postInit() {
     phase = BusPhase::BusIdle;
     holdup = 0;
+    selectedModule = nullptr;
 }
 
 void Memory::clockUp() {
-    machine->debug("Memory::clockUp()");
+    SYSNP_DEBUG(machine, 3, "Memory::clockUp()");
 
     switch (phase) {
         case BusPhase::BusActive:
             if (selectedModule && !writeLatch) {
-                dataLatch = selectedModule->read(addressLatch);
-                dataLatch |= selectedModule->read(addressLatch + 1) << 8;
+                dataLatch = selectedModule->read16(addressLatch);
                 interface->assertSignal(NBusSignal::Data, dataLatch);
             }
             break;
@@ -74,7 +114,7 @@ void Memory::clockUp() {
 }
 
 void Memory::clockDown() {
-    machine->debug("Memory::clockDown()");
+    SYSNP_DEBUG(machine, 3, "Memory::clockDown()");
 
     uint32_t read    = interface->senseSignal(NBusSignal::ReadEnable);
     uint32_t write   = interface->senseSignal(NBusSignal::WriteEnable);
@@ -88,31 +128,21 @@ void Memory::clockDown() {
                 addressLatch = address;
                 readLatch = read;
                 writeLatch = write;
-                for (auto module: modules) {
-                    if (module->containsAddress(addressLatch)) {
-                        selectedModule = module;
-                        break;
-                    }
-                }
+                selectedModule = findModule(addressLatch);
             }
             else {
                 holdup--;
             }
             break;
         case BusPhase::BusActive:
-            for (auto module: modules) {
-                if (module->containsAddress(addressLatch)) {
-                    selectedModule = module;
-                    if (writeLatch & 1) {
-                        selectedModule->write(addressLatch, data & 0xff);
-                    }
-                    if (writeLatch & 2) {
-                        selectedModule->write(addressLatch + 1, data >> 8);
-                    }
-                    break;
-                }
+            if (selectedModule && writeLatch) {
+                selectedModule->write16(addressLatch, data, writeLatch);
+            }
+            // a burst can run on into the next module
+            if (address != addressLatch) {
+                addressLatch = address;
+                selectedModule = findModule(addressLatch);
             }
-            addressLatch = address;
             if (!read) {
                 phase = BusPhase::BusCleanup;
             }
@@ -128,7 +158,7 @@ void Memory::clockDown() {
         case BusPhase::BusIdle:
         default:
             if (read) {
-                if (address < ioHoleAddress || address >= (ioHoleAddress + ioHoleSize)) {
+                if (claimsAddress(address)) {
                     // We are selected
                     phase = BusPhase::BusWait;
                 }
@@ -141,6 +171,103 @@ void Memory::clockDown() {
     }
 }
 
+uint64_t Memory::nextEvent() {
+    if (phase != BusPhase::BusIdle || interface->senseSignal(NBusSignal::ReadEnable)) {
+        return 0;
+    }
+    return UINT64_MAX;
+}
+
+void Memory::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(phase);
+    snapshot.write(holdup);
+    snapshot.write(dataLatch);
+    snapshot.write(addressLatch);
+    snapshot.write(readLatch);
+    snapshot.write(writeLatch);
+
+    int32_t selected = -1;
+    for (int i = 0; i < modules.size(); i++) {
+        if (modules[i].get() == selectedModule) {
+            selected = i;
+        }
+        modules[i]->saveState(snapshot);
+    }
+    snapshot.write(selected);
+}
+void Memory::loadState(SnapshotReader &snapshot) {
+    snapshot.read(phase);
+    snapshot.read(holdup);
+    snapshot.read(dataLatch);
+    snapshot.read(addressLatch);
+    snapshot.read(readLatch);
+    snapshot.read(writeLatch);
+
+    for (auto &module: modules) {
+        module->loadState(snapshot);
+    }
+
+    int32_t selected = snapshot.read<int32_t>();
+    selectedModule = (selected >= 0 && selected < modules.size()) ? modules[selected].get() : nullptr;
+}
+void Memory::saveGeometry(SnapshotWriter &snapshot) {
+    snapshot.write<uint64_t>(modules.size());
+    for (auto &module: modules) {
+        module->saveGeometry(snapshot);
+    }
+}
+
+bool Memory::claimsAddress(uint32_t address) {
+    return address < ioHoleAddress || address >= (ioHoleAddress + ioHoleSize);
+}
+
+int Memory::transact(NBusTransaction &transaction) {
+    // the latency is the first module's, but each word goes to the module
+    // it falls in, as it would in a burst on the bus
+    auto module = findModule(transaction.address);
+    uint32_t address = transaction.address;
+
+    if (transaction.isRead()) {
+        transaction.data.resize(transaction.words);
+        for (int i = 0; i < transaction.words; i++, address += 2) {
+            auto wordModule = findModule(address);
+            transaction.data[i] = wordModule ? wordModule->read16(address) : 0;
+        }
+        return (module ? module->getReadLatency() : 0) + transaction.words;
+    }
+
+    for (int i = 0; i < transaction.words; i++, address += 2) {
+        auto wordModule = findModule(address);
+        if (wordModule) {
+            wordModule->write16(address, transaction.data[i], transaction.writeEnable);
+        }
+    }
+    return (module ? module->getWriteLatency() : 0) + transaction.words;
+}
+
+MemoryModule *Memory::findModule(uint32_t address) {
+    uint32_t page = address >> pageBits;
+    if (page >= pageCount) {
+        return nullptr;
+    }
+
+    int16_t entry = pageMap[page];
+    if (entry >= 0) {
+        return ranges[entry].module;
+    }
+    if (entry == pageUnmapped) {
+        return nullptr;
+    }
+
+    auto range = std::upper_bound(ranges.begin(), ranges.end(), address, [](uint32_t address, const MemoryRange &range) {
+        return address < range.start;
+    });
+    if (range == ranges.begin() || address >= (--range)->end) {
+        return nullptr;
+    }
+    return range->module;
+}
+
 std::string Memory::command(std::stringstream &input)  {
     std::stringstream response;
     std::string locationStr;
@@ -154,14 +281,17 @@ std::string Memory::command(std::stringstream &input)  {
     location <<= 3;
     for (int i = 0; i < length / 8; i++) {
         response << std::setw(8) << std::setfill('0') << std::hex << (location + (i << 3)) << " ";
-        for (int b = 0; b < 8; b++) {
-            uint32_t address = location + (i << 3) + b;
-            for (auto module: modules) {
-                if (module->containsAddress(address)) {
-                    uint8_t datum = module->read(address);
-                    response << " " << std::setw(2) << std::setfill('0') << std::hex << (int) datum;
-                    break;
-                }
+        std::array<uint8_t, 8> line;
+        uint32_t address = location + (i << 3);
+        for (int b = 0; b < 8;) {
+            auto module = findModule(address + b);
+            if (!module) {
+                b++;
+                continue;
+            }
+            size_t count = module->readBlock(address + b, std::span<uint8_t>(line).subspan(b));
+            for (; count > 0; count--, b++) {
+                response << " " << std::setw(2) << std::setfill('0') << std::hex << (int) line[b];
             }
         }
         response << std::endl;
@@ -170,17 +300,68 @@ std::string Memory::command(std::stringstream &input)  {
     return response.str();
 }
 
-MemoryModule::MemoryModule(uint32_t start, uint32_t size, bool rom, std::string romFile, uint8_t readLatency, uint8_t writeLatency, std::string name):
+MemoryModule::MemoryModule(uint32_t start, uint32_t size, bool rom, std::string file, uint8_t readLatency, uint8_t writeLatency, std::string name):
         startAddress(start), size(size), rom(rom), readLatency(readLatency), writeLatency(writeLatency), name(name) {
-    data = new uint8_t[size];
+    data = 0;
+    shared = false;
+    if (size == 0) {
+        return;
+    }
+
+    // RAM without a backing file is an anonymous mapping, so pages are only
+    // committed once the guest touches them.
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "Couldn't map memory module \"" + name + "\"");
+    }
+    data = (uint8_t *) mapping;
+
+    if (file.empty()) {
+        return;
+    }
+
+    int fd = open(file.c_str(), rom ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+    if (fd < 0) {
+        if (rom) {
+            // Missing images read as zeros.
+            mprotect(data, size, PROT_READ);
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "Couldn't open \"" + file + "\" for memory module \"" + name + "\"");
+    }
+
+    struct stat status;
+    fstat(fd, &status);
+    size_t length = size;
+    if (rom) {
+        // ROM images are mapped privately over the front of the zeroed
+        // region; the tail past the end of the file stays anonymous.
+        length = std::min<size_t>(length, status.st_size);
+    }
+    else if (status.st_size < size && ftruncate(fd, size) != 0) {
+        close(fd);
+        throw std::system_error(errno, std::generic_category(), "Couldn't size \"" + file + "\" for memory module \"" + name + "\"");
+    }
+
+    if (length > 0) {
+        mapping = mmap(data, length, rom ? PROT_READ : (PROT_READ | PROT_WRITE), (rom ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::system_error(errno, std::generic_category(), "Couldn't map \"" + file + "\" for memory module \"" + name + "\"");
+        }
+    }
+    close(fd);
+
     if (rom) {
-        std::ifstream fin(romFile, std::ifstream::binary);
-        fin.read((char *) data, size);
+        mprotect(data, size, PROT_READ);
+    }
+    else {
+        shared = true;
     }
 }
 MemoryModule::~MemoryModule() {
     if (data != 0) {
-        delete data;
+        munmap(data, size);
         data = 0;
     }
 }
@@ -188,6 +369,12 @@ MemoryModule::~MemoryModule() {
 bool MemoryModule::containsAddress(uint32_t address) {
     return address >= startAddress && address < (startAddress + size);
 }
+uint32_t MemoryModule::getStartAddress() {
+    return startAddress;
+}
+uint32_t MemoryModule::getSize() {
+    return size;
+}
 std::string MemoryModule::getName() {
     return name;
 }
@@ -212,6 +399,131 @@ void MemoryModule::write(uint32_t address, uint8_t datum) {
     data[address - startAddress] = datum;
 }
 
+uint16_t MemoryModule::read16(uint32_t address) {
+    uint32_t offset = address - startAddress;
+    if (address < startAddress || offset + 1 >= size) {
+        return read(address) | (read(address + 1) << 8);
+    }
+
+    return data[offset] | (data[offset + 1] << 8);
+}
+void MemoryModule::write16(uint32_t address, uint16_t datum, uint8_t enable) {
+    uint32_t offset = address - startAddress;
+    if (rom || address < startAddress || offset + 1 >= size) {
+        if (enable & 1) {
+            write(address, datum & 0xff);
+        }
+        if (enable & 2) {
+            write(address + 1, datum >> 8);
+        }
+        return;
+    }
+
+    if (enable & 1) {
+        data[offset] = datum & 0xff;
+    }
+    if (enable & 2) {
+        data[offset + 1] = datum >> 8;
+    }
+}
+
+size_t MemoryModule::readBlock(uint32_t address, std::span<uint8_t> block) {
+    if (address < startAddress || address >= (startAddress + size)) {
+        return 0;
+    }
+
+    size_t count = std::min<size_t>(block.size(), startAddress + size - address);
+    std::memcpy(block.data(), data + (address - startAddress), count);
+    return count;
+}
+size_t MemoryModule::writeBlock(uint32_t address, std::span<const uint8_t> block) {
+    if (rom || address < startAddress || address >= (startAddress + size)) {
+        return 0;
+    }
+
+    size_t count = std::min<size_t>(block.size(), startAddress + size - address);
+    std::memcpy(data + (address - startAddress), block.data(), count);
+    return count;
+}
+
+// RAM is stored page by page, skipping pages that are all zero, with the
+// stored pages aligned in the snapshot so that a restore can map them
+// copy-on-write instead of copying. ROM is left alone.
+void MemoryModule::saveState(SnapshotWriter &snapshot) {
+    if (rom) {
+        return;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pageCount = (size + pageSize - 1) / pageSize;
+    std::vector<uint8_t> present(pageCount, 0);
+    for (size_t page = 0; page < pageCount; page++) {
+        size_t length = std::min<size_t>(pageSize, size - page * pageSize);
+        const uint8_t *bytes = data + page * pageSize;
+        present[page] = bytes[0] != 0 || std::memcmp(bytes, bytes + 1, length - 1) != 0;
+    }
+    snapshot.write(present);
+
+    snapshot.align(pageSize);
+    for (size_t page = 0; page < pageCount; page++) {
+        if (present[page]) {
+            size_t length = std::min<size_t>(pageSize, size - page * pageSize);
+            snapshot.writeBytes(data + page * pageSize, length);
+            snapshot.align(pageSize);
+        }
+    }
+}
+void MemoryModule::loadState(SnapshotReader &snapshot) {
+    if (rom) {
+        return;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pageCount = (size + pageSize - 1) / pageSize;
+    std::vector<uint8_t> present;
+    snapshot.read(present);
+    if (present.size() != pageCount) {
+        throw std::runtime_error("Snapshot page layout doesn't match memory module \"" + name + "\"");
+    }
+
+    // Private RAM starts over from a fresh zero mapping, so skipped pages
+    // cost nothing; file-backed RAM has to be written through.
+    if (shared || mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        std::memset(data, 0, size);
+    }
+
+    snapshot.align(pageSize);
+    for (size_t page = 0; page < pageCount;) {
+        if (!present[page]) {
+            page++;
+            continue;
+        }
+
+        size_t run = 0;
+        while (page + run < pageCount && present[page + run]) {
+            run++;
+        }
+        size_t length = std::min<size_t>(run * pageSize, size - page * pageSize);
+        if (shared) {
+            snapshot.readBytes(data + page * pageSize, length);
+        }
+        else {
+            snapshot.mapBytes(data + page * pageSize, length);
+        }
+        snapshot.align(pageSize);
+        page += run;
+    }
+}
+// The page size is the host's, which the stored pages are aligned to.
+void MemoryModule::saveGeometry(SnapshotWriter &snapshot) {
+    snapshot.write(startAddress);
+    snapshot.write(size);
+    snapshot.write(rom);
+    if (!rom) {
+        snapshot.write<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+}
+
 }; // namespace nbus
 
 }; // namespace sysnp
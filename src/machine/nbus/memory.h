@@ -3,6 +3,8 @@
 
 #include <string>
 #include <sstream>
+#include <array>
+#include <span>
 
 #include "nbus.h"
 
@@ -23,10 +25,39 @@ class Memory : public NBusDevice {
         virtual void clockUp();
         virtual void clockDown();
 
+        virtual uint64_t nextEvent();
+
+        virtual void saveState(SnapshotWriter&);
+        virtual void loadState(SnapshotReader&);
+        virtual void saveGeometry(SnapshotWriter&);
+
+        virtual bool claimsAddress(uint32_t);
+        virtual int transact(NBusTransaction&);
+
         virtual std::string command(std::stringstream&);
     private:
+        struct MemoryRange {
+            uint32_t start;
+            uint32_t end;
+            MemoryModule *module;
+        };
+
+        // The decoder splits the 24-bit address space into pages. A page
+        // owned by a single module maps straight to it; pages shared by
+        // several modules (or only partly covered) fall back to a binary
+        // search over the sorted ranges.
+        const static int pageBits = 12;
+        const static int pageCount = 1 << (24 - pageBits);
+        const static int16_t pageUnmapped = -1;
+        const static int16_t pageSplit = -2;
+
         std::vector<std::shared_ptr<MemoryModule>> modules;
-        std::shared_ptr<MemoryModule> selectedModule;
+        std::vector<MemoryRange> ranges;
+        std::array<int16_t, pageCount> pageMap;
+        MemoryModule *selectedModule;
+
+        void buildDecoder();
+        MemoryModule *findModule(uint32_t);
 
         uint32_t ioHoleAddress;
         uint32_t ioHoleSize;
@@ -46,12 +77,27 @@ class MemoryModule {
         ~MemoryModule();
 
         bool containsAddress(uint32_t);
+        uint32_t getStartAddress();
+        uint32_t getSize();
         std::string getName();
         uint8_t getReadLatency();
         uint8_t getWriteLatency();
 
         uint8_t read(uint32_t);
         void write(uint32_t, uint8_t);
+
+        // Little-endian bus word; bit 0 of the enable mask selects the low
+        // byte, bit 1 the high byte.
+        uint16_t read16(uint32_t);
+        void write16(uint32_t, uint16_t, uint8_t);
+
+        // Copy up to the end of the module, returning the bytes transferred.
+        size_t readBlock(uint32_t, std::span<uint8_t>);
+        size_t writeBlock(uint32_t, std::span<const uint8_t>);
+
+        void saveState(SnapshotWriter&);
+        void loadState(SnapshotReader&);
+        void saveGeometry(SnapshotWriter&);
     private:
         uint32_t startAddress;
         uint32_t size;
@@ -59,6 +105,7 @@ class MemoryModule {
         uint8_t writeLatency;
         uint8_t *data;
         bool rom;
+        bool shared;
 
         std::string name;
 };
@@ -4,6 +4,9 @@
 #include <bitset>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
 
 namespace sysnp {
 
@@ -15,17 +18,22 @@ NBusInterface::NBusInterface(std::shared_ptr<NBus> inBus, std::shared_ptr<Device
     for (unsigned i = 0; i <= NBusSignal::NotReady; i++) {
         signals[i] = 0;
     }
+    busIndex = bus->attachInterface(this);
+}
+NBusInterface::~NBusInterface() {
+    bus->detachInterface(busIndex);
 }
 
 void NBusInterface::assertSignal(NBusSignal signal, uint32_t value) {
+    if (signals[signal] == value) {
+        return;
+    }
     signals[signal] = value;
+    bus->resolveSignal(signal, busIndex);
 }
 void NBusInterface::deassertSignal(NBusSignal signal) {
     assertSignal(signal, 0);
 }
-uint32_t NBusInterface::senseSignal(NBusSignal signal) {
-    return bus->senseSignal(signal);
-}
 
 void NBusInterface::clockUp() {
     device->clockUp();
@@ -33,8 +41,14 @@ void NBusInterface::clockUp() {
 void NBusInterface::clockDown() {
     device->clockDown();
 }
+uint64_t NBusInterface::nextEvent() {
+    return device->nextEvent();
+}
+void NBusInterface::skipCycles(uint64_t cycles) {
+    device->skipCycles(cycles);
+}
 
-NBus::NBus() {
+NBus::NBus(): compiled(false), transactionMode(false) {
     signalMasks[NBusSignal::Address] = 0xffffff;
     signalMasks[NBusSignal::Data] = 0xffff;
     signalMasks[NBusSignal::WriteEnable] = 0b11;
@@ -44,10 +58,20 @@ NBus::NBus() {
     signalMasks[NBusSignal::Interrupt2] = 1;
     signalMasks[NBusSignal::Interrupt3] = 1;
     signalMasks[NBusSignal::NotReady] = 1;
+
+    signalDrivers.fill(0);
+    resolvedSignals.fill(0);
 }
 
 void NBus::init(ryml::NodeRef &setting) {
     this->machine = machine;
+
+    if (setting.has_child("mode")) {
+        std::string mode;
+        setting["mode"] >> mode;
+        transactionMode = mode == "transaction";
+    }
+
     auto devicesConfig = setting["devices"];
     int deviceCount = devicesConfig.num_children();
     for (int i = 0; i < deviceCount; i++) {
@@ -66,9 +90,12 @@ void NBus::postInit() {
             std::shared_ptr<NBusInterface> interface = std::make_shared<NBusInterface>(shared_from_this(), device);
             device->setInterface(interface);
             addInterface(interface);
+            transactionTargets.push_back(device.get());
         }
     }
     selfInterface = std::make_shared<NBusInterface>(shared_from_this(), shared_from_this());
+
+    setCompiled(true);
 }
 
 std::string NBus::command(std::stringstream &input) {
@@ -149,33 +176,171 @@ std::shared_ptr<NBusInterface> NBus::getIndependentInterface() {
     return selfInterface;
 }
 
-uint32_t NBus::senseSignal(NBusSignal signal) {
-    uint32_t signalValue = 0;
+int NBus::transact(NBusTransaction &transaction) {
+    transaction.address &= signalMasks[NBusSignal::Address] & ~1;
 
-    for (auto interface: interfaces) {
-        signalValue |= interface->signals[signal];
+    for (NBusDevice *device: transactionTargets) {
+        if (device->claimsAddress(transaction.address)) {
+            return device->transact(transaction);
+        }
     }
 
-    signalValue |= selfInterface->signals[signal];
+    // nobody answered; reads float to zero
+    if (transaction.isRead()) {
+        transaction.data.assign(transaction.words, 0);
+    }
+    return transaction.words;
+}
 
-    signalValue &= signalMasks[signal];
+int NBus::attachInterface(NBusInterface *interface) {
+    int index = 0;
+    for (; index < attachedInterfaces.size(); index++) {
+        if (!attachedInterfaces[index]) {
+            attachedInterfaces[index] = interface;
+            return index;
+        }
+    }
 
-    return signalValue;
+    if (index >= 64) {
+        throw std::length_error("NBus supports at most 64 interfaces");
+    }
+    attachedInterfaces.push_back(interface);
+    return index;
+}
+void NBus::detachInterface(int index) {
+    attachedInterfaces[index] = nullptr;
+    for (unsigned signal = 0; signal <= NBusSignal::NotReady; signal++) {
+        if (signalDrivers[signal] & (1ull << index)) {
+            resolveSignal((NBusSignal) signal, index);
+        }
+    }
+}
+
+void NBus::resolveSignal(NBusSignal signal, int index) {
+    uint64_t driver = 1ull << index;
+    NBusInterface *interface = attachedInterfaces[index];
+    if (interface && interface->signals[signal]) {
+        signalDrivers[signal] |= driver;
+    }
+    else {
+        signalDrivers[signal] &= ~driver;
+    }
+
+    // almost always zero or one driver
+    uint32_t signalValue = 0;
+    for (uint64_t drivers = signalDrivers[signal]; drivers; drivers &= drivers - 1) {
+        signalValue |= attachedInterfaces[std::countr_zero(drivers)]->signals[signal];
+    }
+
+    resolvedSignals[signal] = signalValue & signalMasks[signal];
 }
 
 void NBus::clockUp() {
-    for (auto interface: interfaces) {
+    if (compiled) {
+        for (Device *device: schedule) {
+            device->clockUp();
+        }
+        return;
+    }
+
+    for (auto &interface: interfaces) {
         interface->clockUp();
     }
 }
 void NBus::clockDown() {
-    for (auto interface: interfaces) {
+    if (compiled) {
+        for (Device *device: schedule) {
+            device->clockDown();
+        }
+        return;
+    }
+
+    for (auto &interface: interfaces) {
         interface->clockDown();
     }
 }
 
+uint64_t NBus::nextEvent() {
+    uint64_t next = UINT64_MAX;
+    if (compiled) {
+        for (Device *device: schedule) {
+            next = std::min(next, device->nextEvent());
+            if (next == 0) {
+                break;
+            }
+        }
+        return next;
+    }
+
+    for (auto &interface: interfaces) {
+        next = std::min(next, interface->nextEvent());
+        if (next == 0) {
+            break;
+        }
+    }
+    return next;
+}
+void NBus::skipCycles(uint64_t cycles) {
+    if (compiled) {
+        for (Device *device: schedule) {
+            device->skipCycles(cycles);
+        }
+        return;
+    }
+
+    for (auto &interface: interfaces) {
+        interface->skipCycles(cycles);
+    }
+}
+
+void NBus::saveState(SnapshotWriter &snapshot) {
+    for (auto interface: attachedInterfaces) {
+        if (interface) {
+            snapshot.write(interface->signals);
+        }
+    }
+}
+void NBus::loadState(SnapshotReader &snapshot) {
+    for (auto interface: attachedInterfaces) {
+        if (!interface) {
+            continue;
+        }
+
+        std::array<uint32_t, NBusSignal::NotReady + 1> signals;
+        snapshot.read(signals);
+        for (unsigned signal = 0; signal <= NBusSignal::NotReady; signal++) {
+            interface->assertSignal((NBusSignal) signal, signals[signal]);
+        }
+    }
+}
+
+void NBus::saveGeometry(SnapshotWriter &snapshot) {
+    snapshot.write<uint64_t>(attachedInterfaces.size());
+    for (auto interface: attachedInterfaces) {
+        snapshot.write<bool>(interface != nullptr);
+    }
+}
+
 void NBus::addInterface(std::shared_ptr<NBusInterface> interface) {
     interfaces.push_back(interface);
+    if (compiled) {
+        setCompiled(true);
+    }
+}
+
+void NBus::setCompiled(bool enable) {
+    schedule.clear();
+    if (enable) {
+        // the interfaces own the devices, so these stay valid for as long
+        // as the bus does
+        for (auto &interface: interfaces) {
+            schedule.push_back(interface->getDevice());
+        }
+    }
+    compiled = enable;
+}
+bool NBus::isCompiled() {
+    return compiled;
 }
 
 }; // namespace nbus
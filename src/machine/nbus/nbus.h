@@ -27,6 +27,16 @@ enum NBusSignal {
     NotReady,
 };
 
+// What a master drives on ReadEnable: one word, or a burst that goes on for
+// as long as it stays asserted. The master presents each word's address in
+// a burst, so a line can be read starting from the word it wants first,
+// wrapping round to the start of the line.
+enum NBusReadMode {
+    NBusReadNone  = 0b00,
+    NBusReadWord  = 0b01,
+    NBusReadBurst = 0b10
+};
+
 enum BusPhase {
     BusIdle,
     BusBegin,
@@ -35,7 +45,19 @@ enum BusPhase {
     BusCleanup
 };
 
+// A complete bus operation, handed to the target device in one call when
+// the bus runs in transaction mode.
+struct NBusTransaction {
+    uint32_t address = 0; // word-aligned bus address
+    uint32_t writeEnable = 0; // byte lanes written, as on WriteEnable; 0 for reads
+    int words = 0;
+    std::vector<uint16_t> data;
+
+    bool isRead() { return writeEnable == 0; }
+};
+
 class NBusInterface;
+class NBusDevice;
 
 class NBus : public Device , public std::enable_shared_from_this<NBus>  {
     public:
@@ -45,43 +67,91 @@ class NBus : public Device , public std::enable_shared_from_this<NBus>  {
         virtual void clockUp  ();
         virtual void clockDown();
 
-        uint32_t senseSignal(NBusSignal);
+        virtual uint64_t nextEvent();
+        virtual void skipCycles(uint64_t);
+
+        virtual void saveState(SnapshotWriter&);
+        virtual void loadState(SnapshotReader&);
+        virtual void saveGeometry(SnapshotWriter&);
+
+        uint32_t senseSignal(NBusSignal signal) { return resolvedSignals[signal]; }
 
         void addInterface(std::shared_ptr<NBusInterface>);
         std::shared_ptr<NBusInterface> getIndependentInterface();
 
+        // In transaction mode, bus masters hand whole operations to the
+        // addressed device instead of driving the handshake signals.
+        bool isTransactionMode() { return transactionMode; }
+        int transact(NBusTransaction&);
+
+        // In compiled mode the attached devices are clocked straight from a
+        // flat schedule of raw pointers, bypassing the interfaces.
+        void setCompiled(bool);
+        bool isCompiled();
+
         virtual void init(ryml::NodeRef&);
         virtual void postInit();
 
         virtual std::string command(std::stringstream&);
     private:
         std::vector<std::shared_ptr<NBusInterface>> interfaces;
+        std::vector<Device*> schedule;
+        bool compiled;
         std::vector<std::string> deviceNames;
+        std::vector<NBusDevice*> transactionTargets;
+        bool transactionMode;
         std::array<uint32_t, NBusSignal::NotReady + 1> signalMasks;
 
+        // Wired-OR resolution is kept up to date as interfaces drive the
+        // lines: per signal, a bitmask of the attached interfaces currently
+        // driving it non-zero, and the resolved (masked) value.
+        std::vector<NBusInterface*> attachedInterfaces;
+        std::array<uint64_t, NBusSignal::NotReady + 1> signalDrivers;
+        std::array<uint32_t, NBusSignal::NotReady + 1> resolvedSignals;
+
+        int  attachInterface(NBusInterface*);
+        void detachInterface(int);
+        void resolveSignal(NBusSignal, int);
+
         std::shared_ptr<NBusInterface> selfInterface;
+
+        friend class NBusInterface;
 };
 
 class NBusInterface {
     public:
         NBusInterface(std::shared_ptr<NBus>, std::shared_ptr<Device>);
-        virtual ~NBusInterface() {};
+        virtual ~NBusInterface();
         void assertSignal(NBusSignal, uint32_t);
         void deassertSignal(NBusSignal);
-        uint32_t senseSignal(NBusSignal);
+        uint32_t senseSignal(NBusSignal signal) { return bus->senseSignal(signal); }
 
         virtual void clockUp  ();
         virtual void clockDown();
+
+        uint64_t nextEvent();
+        void skipCycles(uint64_t);
+
+        bool isTransactionMode() { return bus->isTransactionMode(); }
+        int transact(NBusTransaction &transaction) { return bus->transact(transaction); }
+
+        Device *getDevice() { return device.get(); }
     private:
         std::array<uint32_t, NBusSignal::NotReady + 1> signals;
         std::shared_ptr<NBus> bus;
         std::shared_ptr<Device> device;
-        friend uint32_t NBus::senseSignal(NBusSignal);
+        int busIndex;
+        friend class NBus;
 };
 
 class NBusDevice : public Device {
     public:
         void setInterface(std::shared_ptr<NBusInterface> newInterface) { this->interface = newInterface; }
+
+        // Transaction mode: whether this device answers at the given bus
+        // address, and the whole transfer, returning its latency in cycles.
+        virtual bool claimsAddress(uint32_t) { return false; }
+        virtual int transact(NBusTransaction&) { return 0; }
     protected:
         std::shared_ptr<NBusInterface> interface;
 };
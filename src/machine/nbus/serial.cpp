@@ -6,6 +6,7 @@
 #include <termios.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <stdexcept>
 
 namespace sysnp {
 
@@ -13,15 +14,7 @@ namespace nbus {
 
 
 Serial::~Serial() {
-    ttyRunning = false;
-    if (ttyWriteThread.joinable()) {
-        ttyWriteThread.join();
-    }
-    if (ttyReadThread.joinable()) {
-        ttyReadThread.join();
-    }
-
-    close(ttyHandle);
+    ttyClose();
 }
 
 void Serial::init(ryml::NodeRef &setting) {
@@ -30,6 +23,12 @@ void Serial::init(ryml::NodeRef &setting) {
     setting["tty"      ] >> ttyFile;
     setting["ioAddress"] >> ioAddress;
     setting["interrupt"] >> intAssignment;
+    if (setting.has_child("input")) {
+        setting["input"] >> inputPath;
+    }
+    if (setting.has_child("output")) {
+        setting["output"] >> outputPath;
+    }
 
     if (intAssignment == 0) {
         interrupt = NBusSignal::Interrupt0;
@@ -46,11 +45,17 @@ void Serial::init(ryml::NodeRef &setting) {
 
     lastOutData = false;
     hasOutData = false;
+    hasInData = false;
     holdup = 0;
     phase = BusPhase::BusIdle;
 }
 
 void Serial::postInit() {
+    if (!inputPath.empty() || !outputPath.empty()) {
+        attachFiles(inputPath, outputPath);
+        return;
+    }
+
     try {
         ttyHandle = open(ttyFile.c_str(), O_RDWR);
         if (!ttyHandle) {
@@ -108,32 +113,64 @@ void Serial::postInit() {
     }
 }
 
-void Serial::clockUp() {
-    machine->debug("Serial::clockUp()");
+void Serial::attachFiles(const std::string &input, const std::string &output) {
+    ttyClose();
 
-    switch (phase) {
-        case BusPhase::BusActive:
-            if (!writeLatch) {
-                machine->debug(6, "Serial::clockUp() SerialReadLatency");
+    fileMode = true;
+    inputFile.close();
+    outputFile.close();
+    if (!input.empty()) {
+        inputFile.open(input, std::ifstream::binary);
+        if (!inputFile.is_open()) {
+            throw std::runtime_error("Couldn't open serial input \"" + input + "\"");
+        }
+    }
+    if (!output.empty()) {
+        outputFile.open(output, std::ofstream::binary | std::ofstream::trunc);
+        if (!outputFile.is_open()) {
+            throw std::runtime_error("Couldn't open serial output \"" + output + "\"");
+        }
+    }
+}
 
-                uint16_t data = 0;
+void Serial::ttyClose() {
+    ttyRunning = false;
+    if (ttyWriteThread.joinable()) {
+        ttyWriteThread.join();
+    }
+    if (ttyReadThread.joinable()) {
+        ttyReadThread.join();
+    }
+    if (ttyHandle >= 0) {
+        close(ttyHandle);
+        ttyHandle = -1;
+    }
+}
 
-                inDataMutex.lock();
+void Serial::fileTransfer() {
+    // writeData already stored the byte; this stands in for the tty
+    // finishing with it
+    hasOutData = false;
 
-                if (hasInData) {
-                    machine->debug(6, "Serial::clockUp() - found data");
-                    data = inData;
-                    data |= 0x100;
-                }
-                if (hasOutData) {
-                    data |= 0x200;
-                }
+    char buffer;
+    if (!hasInData && inputFile.is_open() && inputFile.get(buffer)) {
+        inData = buffer;
+        hasInData = true;
+    }
+}
+
+void Serial::clockUp() {
+    SYSNP_DEBUG(machine, 3, "Serial::clockUp()");
 
-                interface->assertSignal(NBusSignal::Data, data);
-                interface->deassertSignal(interrupt);
-                hasInData = false;
+    if (fileMode) {
+        fileTransfer();
+    }
 
-                inDataMutex.unlock();
+    switch (phase) {
+        case BusPhase::BusActive:
+            if (!writeLatch) {
+                SYSNP_DEBUG(machine, 6, "Serial::clockUp() SerialReadLatency");
+                interface->assertSignal(NBusSignal::Data, readStatus());
             }
             break;
         default:
@@ -143,14 +180,14 @@ void Serial::clockUp() {
 
     bool newOutData = hasOutData;
     if (hasInData || (lastOutData && !newOutData)) {
-        machine->debug(6, "Serial::clockUp() Interrupting");
+        SYSNP_DEBUG(machine, 6, "Serial::clockUp() Interrupting");
         interface->assertSignal(interrupt, 1);
     }
     lastOutData = newOutData;
 }
 
 void Serial::clockDown() {
-    machine->debug("Serial::clockDown()");
+    SYSNP_DEBUG(machine, 3, "Serial::clockDown()");
 
     uint32_t read    = interface->senseSignal(NBusSignal::ReadEnable);
     uint32_t write   = interface->senseSignal(NBusSignal::WriteEnable);
@@ -171,13 +208,7 @@ void Serial::clockDown() {
             break;
         case BusPhase::BusActive:
             if (writeLatch & 1) {
-                outDataMutex.lock();
-
-                outData = (uint8_t) data & 0xff;
-                hasOutData = true;
-                lastOutData = true;
-
-                outDataMutex.unlock();
+                writeData(data & 0xff);
             }
 
             addressLatch = address;
@@ -196,7 +227,7 @@ void Serial::clockDown() {
         case BusPhase::BusIdle:
         default:
             if (read) {
-                if (address == ioAddress) {
+                if (claimsAddress(address)) {
                     // We are selected
                     phase = BusPhase::BusWait;
                 }
@@ -209,6 +240,116 @@ void Serial::clockDown() {
     }
 }
 
+uint64_t Serial::nextEvent() {
+    if (phase != BusPhase::BusIdle || interface->senseSignal(NBusSignal::ReadEnable)) {
+        return 0;
+    }
+    // the tty threads can hand us data at any time, so we're only idle
+    // for as long as there's nothing to report
+    if (hasInData || hasOutData || lastOutData) {
+        return 0;
+    }
+    if (fileMode && inputFile.is_open() && inputFile.peek() != std::ifstream::traits_type::eof()) {
+        return 0;
+    }
+    return UINT64_MAX;
+}
+
+void Serial::saveState(SnapshotWriter &snapshot) {
+    snapshot.write(phase);
+    snapshot.write(holdup);
+    snapshot.write(dataLatch);
+    snapshot.write(addressLatch);
+    snapshot.write(readLatch);
+    snapshot.write(writeLatch);
+    snapshot.write(lastOutData);
+
+    outDataMutex.lock();
+    snapshot.write(outData);
+    snapshot.write(hasOutData);
+    outDataMutex.unlock();
+
+    inDataMutex.lock();
+    snapshot.write(inData);
+    snapshot.write(hasInData);
+    inDataMutex.unlock();
+}
+void Serial::loadState(SnapshotReader &snapshot) {
+    snapshot.read(phase);
+    snapshot.read(holdup);
+    snapshot.read(dataLatch);
+    snapshot.read(addressLatch);
+    snapshot.read(readLatch);
+    snapshot.read(writeLatch);
+    snapshot.read(lastOutData);
+
+    outDataMutex.lock();
+    snapshot.read(outData);
+    snapshot.read(hasOutData);
+    outDataMutex.unlock();
+
+    inDataMutex.lock();
+    snapshot.read(inData);
+    snapshot.read(hasInData);
+    inDataMutex.unlock();
+}
+
+bool Serial::claimsAddress(uint32_t address) {
+    return address == ioAddress;
+}
+
+int Serial::transact(NBusTransaction &transaction) {
+    if (transaction.isRead()) {
+        transaction.data.resize(transaction.words);
+        for (int i = 0; i < transaction.words; i++) {
+            transaction.data[i] = readStatus();
+        }
+    }
+    else if (transaction.writeEnable & 1) {
+        for (int i = 0; i < transaction.words; i++) {
+            writeData(transaction.data[i] & 0xff);
+        }
+    }
+    return transaction.words;
+}
+
+uint16_t Serial::readStatus() {
+    uint16_t data = 0;
+
+    inDataMutex.lock();
+
+    if (hasInData) {
+        SYSNP_DEBUG(machine, 6, "Serial::readStatus() - found data");
+        data = inData;
+        data |= 0x100;
+    }
+    if (hasOutData) {
+        data |= 0x200;
+    }
+
+    interface->deassertSignal(interrupt);
+    hasInData = false;
+
+    inDataMutex.unlock();
+
+    return data;
+}
+
+void Serial::writeData(uint8_t data) {
+    outDataMutex.lock();
+
+    outData = data;
+    hasOutData = true;
+    lastOutData = true;
+
+    outDataMutex.unlock();
+
+    if (fileMode && outputFile.is_open()) {
+        outputFile.put(data);
+        outputFile.flush();
+    }
+}
+
 std::string Serial::command(std::stringstream &input) {
     std::stringstream output;
     output << "Serial" << std::endl;
@@ -239,7 +380,7 @@ void Serial::ttyRead() {
         return;
     }
 
-    machine->debug(6, "Serial byte read");
+    SYSNP_DEBUG(machine, 6, "Serial byte read");
 
     inDataMutex.lock();
     inData = buffer;
@@ -261,7 +402,7 @@ void Serial::ttyWrite() {
     outDataMutex.unlock();
 
     if (hasSendData) {
-        machine->debug(6, "Serial byte written");
+        SYSNP_DEBUG(machine, 6, "Serial byte written");
         write(ttyHandle, &sendData, 1);
     }
 }
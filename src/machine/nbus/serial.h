@@ -5,6 +5,7 @@
 #include <sstream>
 #include <mutex>
 #include <thread>
+#include <fstream>
 
 #include "nbus.h"
 
@@ -14,7 +15,7 @@ namespace nbus {
 
 class Serial : public NBusDevice {
     public:
-        Serial() {}
+        Serial():ttyRunning(false), ttyHandle(-1), fileMode(false) {}
         virtual ~Serial();
 
         virtual void init(ryml::NodeRef &);
@@ -23,7 +24,19 @@ class Serial : public NBusDevice {
         virtual void clockUp();
         virtual void clockDown();
 
+        virtual uint64_t nextEvent();
+
+        virtual void saveState(SnapshotWriter&);
+        virtual void loadState(SnapshotReader&);
+
+        virtual bool claimsAddress(uint32_t);
+        virtual int transact(NBusTransaction&);
+
         virtual std::string command(std::stringstream &);
+
+        // Replace the tty with files, exchanged synchronously with the
+        // clock so that runs are repeatable. Either path may be empty.
+        void attachFiles(const std::string&, const std::string&);
     private:
         uint32_t ioAddress;
         BusPhase phase;
@@ -54,6 +67,18 @@ class Serial : public NBusDevice {
 
         void ttyRead();
         void ttyWrite();
+        void ttyClose();
+
+        std::string   inputPath;
+        std::string   outputPath;
+        bool          fileMode;
+        std::ifstream inputFile;
+        std::ofstream outputFile;
+
+        void fileTransfer();
+
+        uint16_t readStatus();
+        void writeData(uint8_t);
 
         friend void ttyExecute(Serial&, bool);
 };
@@ -0,0 +1,123 @@
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+namespace sysnp {
+
+SnapshotWriter::SnapshotWriter():
+        offset(0) {}
+SnapshotWriter::SnapshotWriter(const std::string &path):
+        path(path), tempPath(path + ".tmp"), offset(0) {
+    out.open(tempPath, std::ofstream::binary | std::ofstream::trunc);
+    if (!out) {
+        throw std::runtime_error("Couldn't create snapshot \"" + tempPath + "\"");
+    }
+}
+SnapshotWriter::~SnapshotWriter() {
+    if (out.is_open()) {
+        out.close();
+        std::remove(tempPath.c_str());
+    }
+}
+
+void SnapshotWriter::write(const std::string &value) {
+    write<uint64_t>(value.size());
+    writeBytes(value.data(), value.size());
+}
+void SnapshotWriter::writeBytes(const void *source, size_t count) {
+    if (path.empty()) {
+        bytes.insert(bytes.end(), (const uint8_t *) source, (const uint8_t *) source + count);
+    }
+    else {
+        out.write((const char *) source, count);
+    }
+    offset += count;
+}
+
+void SnapshotWriter::align(size_t alignment) {
+    static const char zeros[256] = {};
+    while (offset % alignment) {
+        size_t count = alignment - (offset % alignment);
+        writeBytes(zeros, count < sizeof(zeros) ? count : sizeof(zeros));
+    }
+}
+
+void SnapshotWriter::commit() {
+    if (path.empty()) {
+        return;
+    }
+    out.close();
+    if (out.fail() || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Couldn't write snapshot \"" + path + "\"");
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string &path):
+        fd(-1), data(nullptr), size(0), offset(0) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Couldn't open snapshot \"" + path + "\"");
+    }
+
+    struct stat status;
+    fstat(fd, &status);
+    size = status.st_size;
+    if (size > 0) {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::system_error(errno, std::generic_category(), "Couldn't map snapshot \"" + path + "\"");
+        }
+        data = (const uint8_t *) mapping;
+    }
+}
+SnapshotReader::SnapshotReader(const std::vector<uint8_t> &bytes):
+        fd(-1), data(bytes.data()), size(bytes.size()), offset(0) {}
+SnapshotReader::~SnapshotReader() {
+    if (data && fd >= 0) {
+        munmap((void *) data, size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void SnapshotReader::read(std::string &value) {
+    uint64_t count;
+    read(count);
+    value.assign((const char *) peekBytes(count), count);
+    offset += count;
+}
+void SnapshotReader::readBytes(void *bytes, size_t count) {
+    std::memcpy(bytes, peekBytes(count), count);
+    offset += count;
+}
+
+const uint8_t *SnapshotReader::peekBytes(size_t count) {
+    if (count > size - offset) {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    return data + offset;
+}
+
+void SnapshotReader::align(size_t alignment) {
+    offset += (alignment - (offset % alignment)) % alignment;
+}
+
+void SnapshotReader::mapBytes(void *destination, size_t count) {
+    const uint8_t *source = peekBytes(count);
+    void *mapping = fd < 0 ? MAP_FAILED : mmap(destination, count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset);
+    if (mapping == MAP_FAILED) {
+        std::memcpy(destination, source, count);
+    }
+    offset += count;
+}
+
+}; // namespace sysnp
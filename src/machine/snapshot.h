@@ -0,0 +1,111 @@
+#ifndef SYSNP_SNAPSHOT_H
+#define SYSNP_SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace sysnp {
+
+// Binary machine snapshots. Values are written in host byte order, so a
+// snapshot is only meant to be restored on the machine configuration (and
+// host) that produced it.
+
+// Made without a path, a writer keeps the snapshot in memory, where a reader
+// can be made over it.
+class SnapshotWriter {
+    public:
+        SnapshotWriter();
+        SnapshotWriter(const std::string&);
+        ~SnapshotWriter();
+
+        template<typename T>
+        void write(const T &value) {
+            static_assert(std::is_trivially_copyable<T>::value);
+            writeBytes(&value, sizeof(T));
+        }
+        template<typename T>
+        void write(const std::vector<T> &values) {
+            static_assert(std::is_trivially_copyable<T>::value);
+            write<uint64_t>(values.size());
+            writeBytes(values.data(), values.size() * sizeof(T));
+        }
+        void write(const std::string&);
+        void writeBytes(const void*, size_t);
+
+        // Pad with zeros up to a multiple of the given alignment.
+        void align(size_t);
+
+        // Flush and move the snapshot into place; until then the target
+        // file, which may still be mapped by a restored machine, is untouched.
+        void commit();
+
+        const std::vector<uint8_t> &getBytes() const { return bytes; }
+    private:
+        std::string path;
+        std::string tempPath;
+        std::ofstream out;
+        std::vector<uint8_t> bytes;
+        uint64_t offset;
+};
+
+class SnapshotReader {
+    public:
+        SnapshotReader(const std::string&);
+        SnapshotReader(const std::vector<uint8_t>&);
+        ~SnapshotReader();
+
+        template<typename T>
+        void read(T &value) {
+            static_assert(std::is_trivially_copyable<T>::value);
+            readBytes(&value, sizeof(T));
+        }
+        template<typename T>
+        void read(std::vector<T> &values) {
+            static_assert(std::is_trivially_copyable<T>::value);
+            uint64_t count;
+            read(count);
+            if (count > (size - offset) / sizeof(T)) {
+                throw std::runtime_error("Snapshot is truncated");
+            }
+            values.resize(count);
+            readBytes(values.data(), count * sizeof(T));
+        }
+        template<typename T>
+        T read() {
+            T value;
+            read(value);
+            return value;
+        }
+        void read(std::string&);
+        void readBytes(void*, size_t);
+
+        // Read a value and fail unless it matches the current configuration.
+        template<typename T>
+        void expect(const T &value, const std::string &what) {
+            if (read<T>() != value) {
+                throw std::runtime_error("Snapshot doesn't match the configured " + what);
+            }
+        }
+
+        void align(size_t);
+
+        // Place the next bytes of the snapshot at the given page-aligned
+        // address as a private, copy-on-write mapping of the snapshot file.
+        // Falls back to copying where the kernel won't map it, or from memory.
+        void mapBytes(void*, size_t);
+        const uint8_t *peekBytes(size_t);
+    private:
+        int fd;
+        const uint8_t *data;
+        uint64_t size;
+        uint64_t offset;
+};
+
+}; // namespace sysnp
+
+#endif
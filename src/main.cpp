@@ -3,8 +3,76 @@
 
 #include "machine/machine.h"
 
+static void usage(const char *name) {
+    std::cout << "Usage: " << name << " [options] [config.yaml]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Without options, loads the configuration (hardware.yaml by default) and" << std::endl;
+    std::cout << "starts the interactive prompt. Any of the following runs headless instead:" << std::endl;
+    std::cout << "  --batch             run headless without any other stop condition" << std::endl;
+    std::cout << "  --cycles N          stop after N cycles" << std::endl;
+    std::cout << "  --until-halt        stop when the CPU halts" << std::endl;
+    std::cout << "  --until-pc ADDR     stop when ADDR is fetched (may be repeated)" << std::endl;
+    std::cout << "  --serial-in FILE    feed the serial port from FILE" << std::endl;
+    std::cout << "  --serial-out FILE   write serial output to FILE" << std::endl;
+    std::cout << "  --stats FILE        write run statistics (JSON) to FILE instead of stdout" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    std::ifstream file("hardware.yaml", std::ios::in|std::ios::binary|std::ios::ate);
+    std::string configFile = "hardware.yaml";
+    sysnp::BatchOptions batchOptions;
+    bool batch = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        try {
+            if (arg == "-h" || arg == "--help") {
+                usage(argv[0]);
+                return 0;
+            }
+            else if (arg == "--batch") {
+                batch = true;
+            }
+            else if (arg == "--until-halt") {
+                batchOptions.stopOnHalt = true;
+                batch = true;
+            }
+            else if (arg == "--cycles" && hasValue) {
+                batchOptions.maxCycles = std::stoull(argv[++i], nullptr, 0);
+                batch = true;
+            }
+            else if (arg == "--until-pc" && hasValue) {
+                batchOptions.breakpoints.push_back(std::stoul(argv[++i], nullptr, 0));
+                batch = true;
+            }
+            else if (arg == "--serial-in" && hasValue) {
+                batchOptions.serialInput = argv[++i];
+                batch = true;
+            }
+            else if (arg == "--serial-out" && hasValue) {
+                batchOptions.serialOutput = argv[++i];
+                batch = true;
+            }
+            else if (arg == "--stats" && hasValue) {
+                batchOptions.statsFile = argv[++i];
+                batch = true;
+            }
+            else if (arg.starts_with("-")) {
+                usage(argv[0]);
+                return -1;
+            }
+            else {
+                configFile = arg;
+            }
+        }
+        catch (std::logic_error &e) {
+            std::cout << "Invalid value for " << arg << "." << std::endl;
+            return -1;
+        }
+    }
+
+    std::ifstream file(configFile, std::ios::in|std::ios::binary|std::ios::ate);
 
     if (!file.is_open()) {
         std::cout << "Configuration file not found." << std::endl;
@@ -23,8 +91,10 @@ int main(int argc, char* argv[]) {
     std::shared_ptr<sysnp::Machine> machine = std::make_shared<sysnp::Machine>();
 
     machine->load(tree.rootref());
+    if (batch) {
+        return machine->runBatch(batchOptions);
+    }
     machine->run();
-    
+
     return 0;
 }
-
@@ -0,0 +1,139 @@
+#include <boost/test/unit_test.hpp>
+#include "nbus/cpu/breakpointUnit.h"
+#include "machine.h"
+#include "nbus/nbus.h"
+#include "nbus/memory.h"
+#include "nbus/cpu/n16r.h"
+
+using namespace sysnp::nbus::n16r;
+
+BOOST_AUTO_TEST_SUITE(CPU_BreakpointUnit)
+
+BOOST_AUTO_TEST_CASE(breakpoints) {
+    uint16_t registers[48] = {0};
+    BreakpointUnit unit;
+
+    BOOST_CHECK(!unit.isHit(0x80fe0000, registers));
+
+    Breakpoint breakpoint;
+    breakpoint.address = 0x80fe0010;
+    unit.add(breakpoint);
+    BOOST_CHECK( unit.isHit(0x80fe0010, registers));
+    BOOST_CHECK(!unit.isHit(0x80fe0012, registers));
+    BOOST_CHECK(!unit.isHit(0x00fe0010, registers));
+
+    breakpoint.address = 0x1000;
+    breakpoint.compare = BreakEQ;
+    breakpoint.reg = 3;
+    breakpoint.value = 5;
+    unit.add(breakpoint);
+    BOOST_CHECK( unit.contains(0x1000));
+    BOOST_CHECK(!unit.isHit(0x1000, registers));
+    registers[3] = 5;
+    BOOST_CHECK( unit.isHit(0x1000, registers));
+
+    BOOST_CHECK( unit.remove(0x80fe0010));
+    BOOST_CHECK(!unit.remove(0x80fe0010));
+    BOOST_CHECK(!unit.isHit(0x80fe0010, registers));
+    BOOST_CHECK( unit.isHit(0x1000, registers));
+
+    unit.clear();
+    BOOST_CHECK(!unit.contains(0x1000));
+}
+
+BOOST_AUTO_TEST_CASE(watchpoints) {
+    BreakpointUnit unit;
+
+    Watchpoint watchpoint;
+    watchpoint.start = 0x1ffe;
+    watchpoint.size = 4;
+    watchpoint.access = WatchWrite;
+    unit.addWatch(watchpoint);
+
+    BOOST_CHECK( unit.hasWatchpoints());
+    BOOST_CHECK( unit.isWatched(0x1ffe, 1, WatchWrite));
+    BOOST_CHECK( unit.isWatched(0x2000, 2, WatchWrite));
+    BOOST_CHECK( unit.isWatched(0x1ffc, 4, WatchWrite));
+    BOOST_CHECK(!unit.isWatched(0x1ffc, 2, WatchWrite));
+    BOOST_CHECK(!unit.isWatched(0x2002, 2, WatchWrite));
+    BOOST_CHECK(!unit.isWatched(0x1ffe, 2, WatchRead));
+
+    BOOST_CHECK( unit.removeWatch(0x1ffe));
+    BOOST_CHECK(!unit.hasWatchpoints());
+    BOOST_CHECK(!unit.isWatched(0x1ffe, 1, WatchWrite));
+}
+
+BOOST_AUTO_TEST_CASE(breakpointCommand) {
+    uint16_t registers[48] = {0};
+    BreakpointUnit unit;
+
+    std::stringstream add("a 0x40 if 41 != 0");
+    BOOST_CHECK(unit.command(add).empty());
+    BOOST_CHECK(!unit.isHit(0x40, registers));
+    registers[041] = 1;
+    BOOST_CHECK( unit.isHit(0x40, registers));
+
+    std::stringstream watch("w 0x100 2 r");
+    BOOST_CHECK(unit.command(watch).empty());
+    BOOST_CHECK( unit.isWatched(0x101, 1, WatchRead));
+    BOOST_CHECK(!unit.isWatched(0x101, 1, WatchWrite));
+
+    std::stringstream list("l");
+    BOOST_CHECK(unit.command(list) == "break 00000040 if 41 != 0\nwatch 00000100 2 r\n");
+
+    std::stringstream invalid("a 0x40 if 60 == 1");
+    BOOST_CHECK(!unit.command(invalid).empty());
+}
+
+// Runs three addiu $1, 1 then hlt from 0x80000000, with a conditional
+// breakpoint on the third; returns whether it stopped there.
+bool breaksOnThird(const std::string &condition) {
+    std::string config = "root: nbus\n\
+debugLevel: -1\n\
+devices:\n\
+  - {module: nbus, clock: 10000, mode: cycle, device: 0x1f0000, devices: [n16r, memory]}\n\
+  - module: n16r\n\
+    resetAddress: 0x80000000\n\
+    cache:\n\
+      caches:\n\
+        - {type: instruction, binBits: 5, lineBits: 4, ways: 2}\n\
+  - module: memory\n\
+    device: 0x1f0010\n\
+    ioHole: 0xf00000\n\
+    ioHoleSize: 0x040000\n\
+    modules:\n\
+      - {size: 64, name: \"RAM\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n";
+    auto tree = ryml::parse_in_place({config.data(), config.size()});
+    auto machine = std::make_shared<sysnp::Machine>();
+    machine->load(tree.rootref());
+
+    // instructions are big-endian in memory
+    sysnp::nbus::NBusTransaction program;
+    program.writeEnable = 0b11;
+    program.data = {0x0183, 0x0183, 0x0183, 0x2c00};
+    program.words = program.data.size();
+    std::static_pointer_cast<sysnp::nbus::Memory>(machine->getDevice("memory"))->transact(program);
+
+    auto bus = std::static_pointer_cast<sysnp::nbus::NBus>(machine->getDevice("nbus"));
+    auto cpu = std::static_pointer_cast<N16R>(machine->getDevice("n16r"));
+    std::stringstream command("a 0x80000004 if " + condition);
+    cpu->breakpointCommand(command);
+
+    for (int cycle = 0; cycle < 200; cycle++) {
+        bus->clockUp();
+        bus->clockDown();
+        if (cpu->breakpointHit()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(conditionAfterWriteBack) {
+    // the two instructions before it have set the register by then
+    BOOST_CHECK( breaksOnThird("1 == 2"));
+    BOOST_CHECK(!breaksOnThird("1 == 0"));
+    BOOST_CHECK(!breaksOnThird("1 == 3"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
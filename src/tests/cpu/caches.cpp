@@ -107,7 +107,108 @@ BOOST_AUTO_TEST_CASE(singleValueCache) {
 
     Cache<uint32_t, uint16_t, uint32_t, uint16_t> cache(4, 12, 1, true, -1, 0);
 
-    BOOST_CHECK(true);
+    uint16_t page = 0x0012;
+    cache.load(0x00003000, asid, 0x0008, {&page, 1});
+
+    BOOST_CHECK(cache.contains(0x00003abc, 1, asid) == CacheContainsSingle);
+    BOOST_CHECK(cache.contains(0x00013abc, 1, asid) == CacheContainsNone  );
+    BOOST_CHECK(cache.readValue(0x00003abc, 1, asid) == 0x0012);
+    BOOST_CHECK(cache.getFlags (0x00003abc, asid) == 0x0009);
+    BOOST_CHECK(cache.getFlags (0x00004abc, asid) == 0x0000);
+}
+
+BOOST_AUTO_TEST_CASE(fixedWidthReads) {
+    uint32_t asid = 45;
+
+    Cache<uint32_t, uint8_t, uint32_t, uint8_t> cache(5, 4, 1, false, -1, 0);
+    std::vector<uint8_t> lineData;
+    for (int i = 0; i < 16; i++) {
+        lineData.push_back(lineTestData[i] >> 8);
+        lineData.push_back(lineTestData[i] & 0xff);
+    }
+    cache.load(0x100, asid, 0, lineData);
+    cache.load(0x110, asid, 0, std::span<const uint8_t>(lineData).subspan(16));
+
+    BOOST_CHECK(cache.read16(0x100, asid) == 0x2301);
+    BOOST_CHECK(cache.read32(0x100, asid) == 0x67452301);
+    // across two lines
+    BOOST_CHECK(cache.read32(0x10e, asid) == 0x23011032);
+    // a line that isn't cached reads as 0
+    BOOST_CHECK(cache.read16(0x120, asid) == 0);
+
+    uint8_t values[3];
+    cache.get(0x101, values, asid);
+    BOOST_CHECK(values[0] == 0x23);
+    BOOST_CHECK(values[1] == 0x45);
+    BOOST_CHECK(values[2] == 0x67);
+}
+
+BOOST_AUTO_TEST_CASE(associativeCache) {
+    uint32_t asid = 45;
+
+    // 4 sets of 16 ways
+    Cache<uint32_t, uint8_t, uint32_t, uint8_t> cache(2, 4, 4, false, -1, 0);
+    std::vector<uint8_t> lineData(16);
+
+    for (uint32_t way = 0; way < 16; way++) {
+        lineData[0] = way;
+        cache.load(way << 6, asid, way & 1, lineData);
+    }
+    for (uint32_t way = 0; way < 16; way++) {
+        auto line = cache.lookup(way << 6, asid);
+        BOOST_REQUIRE(line.isHit());
+        BOOST_CHECK(line.way == way);
+        BOOST_CHECK(cache.getFlags(line) == ((way & 1) | 1));
+        BOOST_CHECK(cache.get(way << 6, 1, asid)[0] == way);
+    }
+    BOOST_CHECK(!cache.lookup(16 << 6, asid).isHit());
+    BOOST_CHECK(!cache.lookup(0, asid + 1).isHit());
+    BOOST_CHECK(!cache.lookup(1 << 4, asid).isHit());
+
+    // touch all but the second line; loading a 17th evicts it
+    for (uint32_t way = 0; way < 16; way++) {
+        if (way != 1) {
+            cache.read(way << 6, 1, asid);
+        }
+    }
+    cache.load(16 << 6, asid, 0, lineData);
+    BOOST_CHECK(cache.contains(16 << 6, 1, asid) == CacheContainsSingle);
+    BOOST_CHECK(cache.contains( 1 << 6, 1, asid) == CacheContainsNone  );
+    BOOST_CHECK(cache.contains( 2 << 6, 1, asid) == CacheContainsSingle);
+
+    cache.flush(2 << 6, asid);
+    BOOST_CHECK(!cache.lookup(2 << 6, asid).isHit());
+    BOOST_CHECK(cache.selectLine(2 << 6, asid) == 2);
+}
+
+template<typename P>
+int victimAfterTouchingFirst() {
+    // one set of 4 ways, filled in order, then the first way read again
+    Cache<uint32_t, uint8_t, uint32_t, uint8_t, P> cache(0, 4, 2, false, -1, 0);
+    std::vector<uint8_t> lineData(16);
+
+    for (uint32_t way = 0; way < 4; way++) {
+        cache.load(way << 4, 0, 0, lineData);
+    }
+    cache.read(0, 1, 0);
+    return cache.selectLine(4 << 4, 0);
+}
+
+BOOST_AUTO_TEST_CASE(replacementPolicies) {
+    BOOST_CHECK(victimAfterTouchingFirst<LruPolicy     >() == 1);
+    BOOST_CHECK(victimAfterTouchingFirst<TreePlruPolicy>() == 2);
+    BOOST_CHECK(victimAfterTouchingFirst<FifoPolicy    >() == 0);
+    BOOST_CHECK(victimAfterTouchingFirst<SrripPolicy   >() == 1);
+    BOOST_CHECK(victimAfterTouchingFirst<RandomPolicy  >() < 4);
+
+    BOOST_CHECK(parseReplacementPolicy("srrip") == ReplaceSrrip);
+    BOOST_CHECK_THROW(parseReplacementPolicy("mru"), std::invalid_argument);
+
+    ConfiguredCache<uint32_t, uint16_t, uint32_t, uint8_t> cache(ReplaceFifo, 2, 4, 1, false, -1, 0);
+    cache.load(0x40, 7, 0, std::span<const uint16_t>(lineTestData, 16));
+    BOOST_CHECK(cache.lookup(0x40, 7).isHit());
+    BOOST_CHECK(cache.readValue(0x44, 1, 7) == lineTestData[4]);
+    BOOST_CHECK(!cache.lookup(0x40, 8).isHit());
 }
 
 /*
@@ -17,4 +17,374 @@ BOOST_AUTO_TEST_CASE(memoryUnit) {
     BOOST_CHECK(1);
 }
 
+// Reads a line in over the bus, each word holding its own address.
+void fillFromBus(MemoryUnit &unit, uint32_t address) {
+    unit.queueRead(DataRead, address, 2, 0);
+    BOOST_REQUIRE(unit.isOperationPrepared());
+    auto busOp = unit.getBusOperation();
+    for (int i = 0; i < busOp.bytes; i += 2) {
+        unit.ingestWord(address + i);
+    }
+}
+
+bool holds(MemoryUnit &unit, uint32_t address) {
+    return unit.check(MemoryOpDataRead, address, 2, 0).result == MemoryCheckContainsSingle;
+}
+
+BOOST_AUTO_TEST_CASE(levelTwoCache) {
+    uint32_t a = 0x80000000;
+    uint32_t b = 0x80000004;
+    uint32_t c = 0x80000008;
+
+    // a direct-mapped L1 of one 4 byte line in front of a 2 way L2
+    MemoryUnit unit;
+    unit.setCache(DataCache, 32, 0, 2, 1);
+    unit.setCache(UnifiedL2Cache, 32, 0, 2, 2);
+    unit.setLevelTwo(3, InclusiveCache);
+
+    fillFromBus(unit, a);
+    fillFromBus(unit, b);
+    BOOST_CHECK(!holds(unit, a) && holds(unit, b));
+    BOOST_CHECK(unit.read(DataCache, b, 2, 0) == (b & 0xffff));
+
+    // a comes back from the L2 after its latency, without the bus
+    unit.queueRead(DataRead, a, 2, 0);
+    BOOST_CHECK(!unit.isOperationPrepared());
+    for (int cycle = 0; cycle < 3; cycle++) {
+        BOOST_CHECK(!holds(unit, a));
+        unit.clockDown();
+    }
+    BOOST_CHECK(holds(unit, a));
+    BOOST_CHECK(unit.read(DataCache, a + 2, 2, 0) == ((a + 2) & 0xffff));
+    BOOST_CHECK(unit.describeLevelTwo().find("hits: 1, misses: 2") != std::string::npos);
+
+    for (auto inclusion: {InclusiveCache, NonInclusiveCache, ExclusiveCache}) {
+        // two ways at each level
+        MemoryUnit unit;
+        unit.setCache(DataCache, 32, 0, 2, 2);
+        unit.setCache(UnifiedL2Cache, 32, 0, 2, 2);
+        unit.setLevelTwo(3, inclusion);
+
+        fillFromBus(unit, a);
+        fillFromBus(unit, b);
+
+        // the L1 has used a since, but the L2 hasn't, so c replaces b in the
+        // L1 and a in the L2, which an inclusive L2 takes out of the L1 too
+        unit.read(DataCache, a, 2, 0);
+        fillFromBus(unit, c);
+        BOOST_CHECK(holds(unit, c));
+        BOOST_CHECK(holds(unit, a) == (inclusion != InclusiveCache));
+        BOOST_CHECK(holds(unit, b) == (inclusion == InclusiveCache));
+
+        // an exclusive L2 only gets the lines the L1 gives up
+        unit.queueRead(DataRead, c, 2, 0);
+        BOOST_CHECK(unit.isOperationPrepared() == (inclusion == ExclusiveCache));
+    }
+
+    MemoryUnit mismatched;
+    mismatched.setCache(DataCache, 32, 0, 2, 1);
+    BOOST_CHECK_THROW(mismatched.setCache(UnifiedL2Cache, 32, 0, 4, 1), std::invalid_argument);
+    BOOST_CHECK_THROW(parseCacheInclusion("strict"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(writeBackCache) {
+    uint32_t a = 0x80000000;
+    uint32_t b = 0x80000004;
+
+    for (auto mode: {WriteThroughCache, WriteBackCache}) {
+        // a direct-mapped data cache of one 4 byte line
+        MemoryUnit unit;
+        unit.setCache(DataCache, 32, 0, 2, 1, ReplaceLru, mode);
+        fillFromBus(unit, a);
+
+        MemoryOperation store;
+        store.inAddress  = a + 2;
+        store.outAddress = (a + 2) & 0x1fffffff;
+        store.asid       = 0;
+        store.data       = {0x34, 0x12};
+        store.bytes      = 2;
+        store.type       = MemoryOpDataWrite;
+        unit.commitOperation(unit.queueOperation(store));
+
+        // only a write-through cache sends the store on to the bus
+        BOOST_CHECK(unit.read(DataCache, a + 2, 2, 0) == 0x1234);
+        BOOST_CHECK(unit.isOperationPrepared() == (mode == WriteThroughCache));
+        if (mode == WriteThroughCache) {
+            unit.getBusOperation();
+        }
+
+        // the dirty line goes out whole when b replaces it
+        fillFromBus(unit, b);
+        BOOST_CHECK(unit.isOperationPrepared() == (mode == WriteBackCache));
+        if (mode == WriteBackCache) {
+            auto busOp = unit.getBusOperation();
+            BOOST_CHECK(!busOp.isRead);
+            BOOST_CHECK(busOp.address == (a & 0x1fffffff));
+            BOOST_REQUIRE(busOp.data.size() == 2);
+            BOOST_CHECK(busOp.data[0] == (a & 0xffff));
+            BOOST_CHECK(busOp.data[1] == 0x1234);
+        }
+    }
+
+    MemoryUnit unit;
+    BOOST_CHECK_THROW(unit.setCache(InstructionCache, 32, 0, 2, 1, ReplaceLru, WriteBackCache), std::invalid_argument);
+    BOOST_CHECK_THROW(parseCacheMode("writearound"), std::invalid_argument);
+}
+
+MemoryOperation storeOf(uint32_t address, std::vector<uint8_t> data) {
+    MemoryOperation store;
+    store.inAddress  = address;
+    store.outAddress = address & 0x1fffffff;
+    store.asid       = 0;
+    store.bytes      = data.size();
+    store.data.assign(data.begin(), data.end());
+    store.type       = MemoryOpDataWrite;
+    return store;
+}
+
+BOOST_AUTO_TEST_CASE(storeBuffer) {
+    uint32_t a = 0x80000000;
+
+    MemoryUnit unit;
+    unit.setCache(DataCache, 32, 0, 4, 1);
+    unit.setStoreBuffer(4);
+
+    // stores queue up to the buffer's depth
+    std::vector<uint16_t> ids;
+    for (int i = 0; i < 4; i++) {
+        ids.push_back(unit.queueOperation(storeOf(a + i * 2, {(uint8_t) i, 0x10})));
+        BOOST_CHECK(ids.back() != MemoryOperation::invalidOperationId);
+    }
+    BOOST_CHECK(unit.queueOperation(storeOf(a + 8, {0, 0})) == MemoryOperation::invalidOperationId);
+
+    // committed, they merge into one write of the whole run
+    for (auto id: ids) {
+        unit.commitOperation(id);
+    }
+    unit.commitOperation(unit.queueOperation(storeOf(a + 3, {0x20})));
+
+    // and loads of their bytes read them without a cache line
+    BOOST_CHECK(unit.check(MemoryOpDataRead, a + 2, 4, 0).result == MemoryCheckContainsSingle);
+    BOOST_CHECK(unit.read(DataCache, a + 2, 4, 0) == 0x10022001);
+    BOOST_CHECK(unit.check(MemoryOpDataRead, a + 6, 4, 0).result == MemoryCheckContainsNone);
+
+    auto busOp = unit.getBusOperation();
+    BOOST_CHECK(!busOp.isRead);
+    BOOST_CHECK(busOp.address == (a & 0x1fffffff));
+    BOOST_REQUIRE(busOp.data.size() == 4);
+    BOOST_CHECK(busOp.data[0] == 0x1000);
+    BOOST_CHECK(busOp.data[1] == 0x2001);
+    BOOST_CHECK(busOp.data[3] == 0x1003);
+    BOOST_CHECK(!unit.isOperationPrepared());
+
+    // a store doesn't merge across a line
+    unit.commitOperation(unit.queueOperation(storeOf(a + 14, {1, 2})));
+    unit.commitOperation(unit.queueOperation(storeOf(a + 16, {3, 4})));
+    unit.getBusOperation();
+    BOOST_CHECK(unit.isOperationPrepared());
+}
+
+BOOST_AUTO_TEST_CASE(operationQueue) {
+    uint32_t a = 0x80000000;
+
+    // an ID outlives its operation without reaching the next in its slot
+    MemoryUnit unit;
+    uint16_t first = unit.queueOperation(storeOf(a, {1, 2}));
+    unit.invalidateOperation(first);
+    uint16_t second = unit.queueOperation(storeOf(a, {3, 4}));
+    BOOST_CHECK(second != first);
+    unit.commitOperation(first);
+    BOOST_CHECK(!unit.isOperationPrepared());
+    unit.commitOperation(second);
+    BOOST_CHECK(unit.isOperationPrepared());
+    unit.getBusOperation();
+
+    // nor after its slot has been taken many times over
+    for (int i = 0; i < 1000; i++) {
+        uint16_t next = unit.queueOperation(storeOf(a, {5, 6}));
+        BOOST_REQUIRE(next != first);
+        unit.invalidateOperation(next);
+    }
+
+    // the pipeline waits once every tagged slot is in use
+    unit.setStoreBuffer(100);
+    std::vector<uint16_t> stores;
+    uint16_t store;
+    while ((store = unit.queueOperation(storeOf(a, {7, 8}))) != MemoryOperation::invalidOperationId) {
+        stores.push_back(store);
+    }
+    BOOST_CHECK(stores.size() == 64);
+    unit.invalidateOperation(stores[10]);
+    unit.commitOperation(stores[20]);
+    BOOST_CHECK(unit.isOperationPrepared());
+    for (auto id: stores) {
+        unit.invalidateOperation(id);
+    }
+    BOOST_CHECK(!unit.isOperationPrepared());
+    unit.setStoreBuffer(0);
+
+    // a flush queues more lines than there are tagged slots, in order; the
+    // 128 byte lines are longer than an operation holds inline
+    unit.setCache(DataCache, 32, 6, 7, 1, ReplaceLru, WriteBackCache);
+    int lines = 64;
+    for (int i = 0; i < lines; i++) {
+        fillFromBus(unit, a + i * 128);
+        unit.commitOperation(unit.queueOperation(storeOf(a + i * 128 + 2, {(uint8_t) i, 0})));
+    }
+    unit.flushCaches(false);
+    for (int i = 0; i < lines; i++) {
+        auto busOp = unit.getBusOperation();
+        BOOST_REQUIRE(busOp.data.size() == 64);
+        BOOST_CHECK(busOp.address == ((a + i * 128) & 0x1fffffff));
+        BOOST_CHECK(busOp.data[1] == i);
+        BOOST_CHECK(busOp.data[63] == ((a + i * 128 + 126) & 0xffff));
+    }
+    BOOST_CHECK(!unit.isOperationPrepared());
+}
+
+BOOST_AUTO_TEST_CASE(writesPastBus) {
+    uint32_t a = 0x80000000;
+    uint32_t b = 0x80000004;
+
+    // a flushed line can be taken off the queue whole, past a read
+    MemoryUnit unit;
+    unit.setCache(DataCache, 32, 0, 2, 1, ReplaceLru, WriteBackCache);
+    fillFromBus(unit, a);
+    unit.commitOperation(unit.queueOperation(storeOf(a + 2, {0x34, 0x12})));
+    unit.queueRead(DataRead, b, 2, 0);
+    unit.flushCaches(true);
+
+    BusOperation write;
+    BOOST_REQUIRE(unit.takeWrite(write));
+    BOOST_CHECK(!write.isRead);
+    BOOST_CHECK(write.address == (a & 0x1fffffff));
+    BOOST_REQUIRE(write.data.size() == 2);
+    BOOST_CHECK(write.data[1] == 0x1234);
+    BOOST_CHECK(!unit.takeWrite(write));
+
+    // the read still goes out on the bus
+    BOOST_CHECK(unit.isOperationPrepared());
+    BOOST_CHECK(unit.getBusOperation().isRead);
+}
+
+BOOST_AUTO_TEST_CASE(instructionPrefetch) {
+    uint32_t a = 0x80000000;
+
+    // four 16 byte lines, prefetching two ahead
+    MemoryUnit unit;
+    unit.setCache(InstructionCache, 32, 2, 4, 1);
+    unit.setPrefetch(2);
+
+    auto readLine = [&](uint32_t address) {
+        auto busOp = unit.getBusOperation();
+        BOOST_CHECK(busOp.isRead);
+        BOOST_CHECK(busOp.address == (address & 0x1fffffff));
+        for (int i = 0; i < busOp.bytes; i += 2) {
+            unit.ingestWord(address + i);
+        }
+    };
+
+    // a miss goes out first
+    BOOST_CHECK(unit.check(MemoryOpInstructionRead, a, 2, 0).result == MemoryCheckContainsNone);
+    unit.queueRead(InstructionRead, a, 2, 0);
+    BOOST_CHECK(!unit.prefetch());
+    readLine(a);
+
+    // the next lines come in while nothing else wants the bus
+    BOOST_CHECK(unit.prefetch());
+    readLine(a + 16);
+    BOOST_CHECK(unit.prefetch());
+    readLine(a + 32);
+    BOOST_CHECK(!unit.prefetch());
+
+    // fetching from one moves the stream on
+    BOOST_CHECK(unit.check(MemoryOpInstructionRead, a + 16, 2, 0).result == MemoryCheckContainsSingle);
+    BOOST_CHECK(unit.prefetch());
+    readLine(a + 48);
+
+    // and one evicted before it was fetched from was wasted
+    unit.check(MemoryOpInstructionRead, a + 64, 2, 0);
+    unit.queueRead(InstructionRead, a + 64, 2, 0);
+    readLine(a + 64);
+    BOOST_CHECK(unit.describePrefetch() == "prefetch depth: 2, issued: 3, useful: 1, wasted: 0\n");
+    unit.queueRead(InstructionRead, a + 96, 2, 0);
+    readLine(a + 96);
+    BOOST_CHECK(unit.describePrefetch() == "prefetch depth: 2, issued: 3, useful: 1, wasted: 1\n");
+}
+
+BOOST_AUTO_TEST_CASE(criticalWordFirst) {
+    uint32_t a = 0x80000000;
+
+    // a 16 byte line, missed on its third word
+    MemoryUnit unit;
+    unit.setCache(DataCache, 32, 2, 4, 1);
+    unit.setCriticalWordFirst(true);
+
+    unit.queueRead(DataRead, a + 4, 2, 0);
+    auto busOp = unit.getBusOperation();
+    BOOST_CHECK(busOp.isRead);
+    BOOST_CHECK(busOp.address == ((a + 4) & 0x1fffffff));
+    BOOST_CHECK(busOp.wrapBytes == 16);
+    BOOST_CHECK(!holds(unit, a + 4));
+
+    // the word that missed is read as soon as it is in
+    unit.ingestWord(a + 4);
+    BOOST_CHECK(holds(unit, a + 4));
+    BOOST_CHECK(unit.read(DataCache, a + 4, 2, 0) == ((a + 4) & 0xffff));
+    BOOST_CHECK(!holds(unit, a + 4 + 2));
+
+    // and the line is in order once the rest comes round
+    for (uint32_t offset: {6, 8, 10, 12, 14, 0, 2}) {
+        unit.ingestWord(a + offset);
+    }
+    BOOST_CHECK(unit.read(DataCache, a, 4, 0) == (((a + 2) & 0xffff) << 16 | (a & 0xffff)));
+    BOOST_CHECK(unit.read(DataCache, a + 14, 2, 0) == ((a + 14) & 0xffff));
+    BOOST_CHECK(unit.describeCriticalWord() == "critical word first, early restarts: 1\n");
+}
+
+BOOST_AUTO_TEST_CASE(earlyRestartThenStore) {
+    uint32_t a = 0x80000000;
+
+    for (int depth: {0, 4}) {
+        MemoryUnit unit;
+        unit.setCache(DataCache, 32, 2, 4, 1);
+        unit.setCriticalWordFirst(true);
+        unit.setStoreBuffer(depth);
+
+        unit.queueRead(DataRead, a + 4, 2, 0);
+        unit.getBusOperation();
+        unit.ingestWord(a + 4);
+        unit.ingestWord(a + 6);
+        BOOST_CHECK(unit.read(DataCache, a + 4, 2, 0) == ((a + 4) & 0xffff));
+
+        // stores to the line, one to a word in and one to a word still to
+        // come, are seen by loads and kept by the fill
+        unit.commitOperation(unit.queueOperation(storeOf(a + 6, {0xef, 0xbe})));
+        unit.commitOperation(unit.queueOperation(storeOf(a, {0x34, 0x12})));
+        BOOST_CHECK(holds(unit, a + 6));
+        BOOST_CHECK(unit.read(DataCache, a + 6, 2, 0) == 0xbeef);
+
+        for (uint32_t offset: {8, 10, 12, 14, 0, 2}) {
+            unit.ingestWord(a + offset);
+        }
+        BOOST_CHECK(unit.read(DataCache, a + 6, 2, 0) == 0xbeef);
+        BOOST_CHECK(unit.read(DataCache, a, 2, 0) == 0x1234);
+        BOOST_CHECK(unit.read(DataCache, a + 2, 2, 0) == ((a + 2) & 0xffff));
+    }
+
+    // the words in don't get round the page's protection
+    uint32_t page = 0x1000;
+    MemoryUnit unit;
+    unit.setCache(DataCache, 32, 2, 4, 1);
+    unit.setCriticalWordFirst(true);
+    unit.loadTlb(page, page >> 12, CACHE_FLAG_PRES, 0);
+
+    unit.queueRead(DataRead, page + 4, 2, 0);
+    unit.getBusOperation();
+    unit.ingestWord(0x2222);
+    BOOST_CHECK(unit.check(MemoryOpDataRead, page + 4, 2, 0).result == MemoryCheckContainsSingle);
+    BOOST_CHECK(unit.check(MemoryOpDataWrite, page + 4, 2, 0).result == MemoryCheckNoWrite);
+    BOOST_CHECK(unit.check(MemoryOpInstructionRead, page + 4, 2, 0).result != MemoryCheckContainsSingle);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,161 @@
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <fstream>
+#include "machine.h"
+#include "nbus/memory.h"
+
+using namespace sysnp::nbus;
+
+BOOST_AUTO_TEST_SUITE(Machine)
+
+std::shared_ptr<sysnp::Machine> loadMachine(std::string config) {
+    auto tree = ryml::parse_in_place({config.data(), config.size()});
+    auto machine = std::make_shared<sysnp::Machine>();
+    machine->load(tree.rootref());
+    return machine;
+}
+
+std::string machineConfig(std::string caches) {
+    return "root: nbus\n\
+debugLevel: -1\n\
+devices:\n\
+  - {module: nbus, clock: 10000, mode: cycle, device: 0x1f0000, devices: [n16r, memory]}\n\
+  - module: n16r\n\
+    resetAddress: 0x80000000\n\
+    cache:\n\
+      caches: [" + caches + "]\n\
+  - module: memory\n\
+    device: 0x1f0010\n\
+    ioHole: 0xf00000\n\
+    ioHoleSize: 0x040000\n\
+    modules:\n\
+      - {size: 64, name: \"RAM\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n";
+}
+
+uint16_t memoryWord(std::shared_ptr<sysnp::Machine> machine, uint32_t address) {
+    NBusTransaction read;
+    read.address = address;
+    read.words = 1;
+    std::static_pointer_cast<Memory>(machine->getDevice("memory"))->transact(read);
+    return read.data[0];
+}
+
+void setMemoryWord(std::shared_ptr<sysnp::Machine> machine, uint32_t address, uint16_t value) {
+    NBusTransaction write;
+    write.address = address;
+    write.writeEnable = 0b11;
+    write.words = 1;
+    write.data = {value};
+    std::static_pointer_cast<Memory>(machine->getDevice("memory"))->transact(write);
+}
+
+BOOST_AUTO_TEST_CASE(mismatchedSnapshot) {
+    auto path = (std::filesystem::temp_directory_path() / "sysnp-machine.snp").string();
+
+    auto saved = loadMachine(machineConfig("{type: data, binBits: 5, lineBits: 4, ways: 2}"));
+    setMemoryWord(saved, 0x1000, 0x1234);
+    saved->saveSnapshot(path);
+
+    // memory comes before the n16r, whose caches don't match
+    auto other = loadMachine(machineConfig(""));
+    setMemoryWord(other, 0x1000, 0x5678);
+    BOOST_CHECK_THROW(other->loadSnapshot(path), std::runtime_error);
+    BOOST_CHECK(memoryWord(other, 0x1000) == 0x5678);
+
+    setMemoryWord(saved, 0x1000, 0x9abc);
+    saved->loadSnapshot(path);
+    BOOST_CHECK(memoryWord(saved, 0x1000) == 0x1234);
+
+    // a snapshot cut short fails after memory is restored, and is undone
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 16);
+    setMemoryWord(saved, 0x1000, 0x9abc);
+    BOOST_CHECK_THROW(saved->loadSnapshot(path), std::runtime_error);
+    BOOST_CHECK(memoryWord(saved, 0x1000) == 0x9abc);
+
+    std::filesystem::remove(path);
+}
+
+// Runs a counting loop to its halt and hands back the batch stats.
+std::string loopStats(bool pipelined, bool translate, const std::string &mode = "cycle") {
+    auto path = (std::filesystem::temp_directory_path() / "sysnp-machine-stats.json").string();
+    std::string config = "root: nbus\n\
+debugLevel: -1\n\
+devices:\n\
+  - {module: nbus, clock: 10000, mode: " + mode + ", device: 0x1f0000, devices: [n16r, memory]}\n\
+  - module: n16r\n\
+    resetAddress: 0x80000000\n\
+    pipelined: " + std::string(pipelined ? "true" : "false") + "\n\
+    translate: " + std::string(translate ? "true" : "false") + "\n\
+    cache:\n\
+      caches:\n\
+        - {type: instruction, binBits: 5, lineBits: 4, ways: 2}\n\
+  - module: memory\n\
+    device: 0x1f0010\n\
+    ioHole: 0xf00000\n\
+    ioHoleSize: 0x040000\n\
+    modules:\n\
+      - {size: 64, name: \"RAM\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n";
+    auto machine = loadMachine(config);
+
+    // lli $0, 0; lli $6, 100; addiu $0, 1; bne $0, $6, -1; hlt
+    // instructions are big-endian in memory
+    NBusTransaction program;
+    program.writeEnable = 0b11;
+    program.data = {0x00a1, 0x64ad, 0x0181, 0x8161, 0xffff, 0x2c00};
+    program.words = program.data.size();
+    std::static_pointer_cast<Memory>(machine->getDevice("memory"))->transact(program);
+
+    sysnp::BatchOptions options;
+    options.maxCycles = 100000;
+    options.stopOnHalt = true;
+    options.statsFile = path;
+    machine->runBatch(options);
+
+    std::ifstream statsIn(path);
+    std::string stats((std::istreambuf_iterator<char>(statsIn)), std::istreambuf_iterator<char>());
+    std::filesystem::remove(path);
+    return stats;
+}
+
+uint64_t statValue(const std::string &stats, const std::string &name) {
+    auto at = stats.find("\"" + name + "\": ");
+    return at == std::string::npos ? 0 : std::stoull(stats.substr(at + name.size() + 4));
+}
+
+BOOST_AUTO_TEST_CASE(translatedCycles) {
+    auto functional = loopStats(false, false);
+    auto translated = loopStats(false, true);
+
+    BOOST_CHECK(functional.find("\"stop\": \"halt\"") != std::string::npos);
+    BOOST_CHECK(translated.find("\"stop\": \"halt\"") != std::string::npos);
+    BOOST_CHECK(statValue(translated, "retired") == statValue(functional, "retired"));
+
+    // the bus runs through the cycles translated blocks take
+    uint64_t functionalCycles = statValue(functional, "cycles");
+    uint64_t translatedCycles = statValue(translated, "cycles");
+    BOOST_CHECK(functionalCycles > 200);
+    BOOST_CHECK(translatedCycles * 10 > functionalCycles * 9);
+    BOOST_CHECK(translatedCycles * 10 < functionalCycles * 11);
+}
+
+BOOST_AUTO_TEST_CASE(haltedRetirement) {
+    // what the pipeline fetched past the halt never retires
+    auto stats = loopStats(true, false);
+    BOOST_CHECK(stats.find("\"lastRetired\": \"0x8000000a\"") != std::string::npos);
+    BOOST_CHECK(statValue(stats, "retired") == 203);
+}
+
+BOOST_AUTO_TEST_CASE(fetchWaits) {
+    // waiting on a fetch goes by at once, in as many cycles as stepping takes
+    auto pipelined = loopStats(true, false, "transaction");
+    BOOST_CHECK(statValue(pipelined, "idleCycles") > 0);
+    BOOST_CHECK(statValue(pipelined, "cycles") == 617);
+    BOOST_CHECK(statValue(pipelined, "retired") == 203);
+
+    auto functional = loopStats(false, false, "transaction");
+    BOOST_CHECK(statValue(functional, "idleCycles") > 0);
+    BOOST_CHECK(statValue(functional, "cycles") == 211);
+    BOOST_CHECK(statValue(functional, "retired") == 203);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,4 +1,5 @@
 #include <boost/test/unit_test.hpp>
+#include <filesystem>
 #include "machine.h"
 #include "nbus/memory.h"
 
@@ -19,6 +20,92 @@ BOOST_AUTO_TEST_CASE(memoryModule) {
     module.write(0xff01, 0xaa);
     BOOST_CHECK(module.read(0xff00) == 0x55);
     BOOST_CHECK(module.read(0xff01) == 0xaa);
+    BOOST_CHECK(module.read16(0xff00) == 0xaa55);
+
+    module.write16(0xff00, 0x1234, 0b01);
+    BOOST_CHECK(module.read16(0xff00) == 0xaa34);
+    module.write16(0xff00, 0x1234, 0b10);
+    BOOST_CHECK(module.read16(0xff00) == 0x1234);
+
+    // Words straddling the end of the module only touch the byte inside it
+    module.write16(0xffff, 0x5678, 0b11);
+    BOOST_CHECK(module.read16(0xffff) == 0x0078);
+
+    std::array<uint8_t, 4> block = {1, 2, 3, 4};
+    BOOST_CHECK(module.writeBlock(0xfffe, block) == 2);
+    BOOST_CHECK(module.writeBlock(0x10000, block) == 0);
+    BOOST_CHECK(module.read16(0xfffe) == 0x0201);
+
+    std::array<uint8_t, 4> readBack = {};
+    BOOST_CHECK(module.readBlock(0xff00, readBack) == 4);
+    BOOST_CHECK(readBack[0] == 0x34 && readBack[1] == 0x12 && readBack[2] == 0 && readBack[3] == 0);
+}
+
+BOOST_AUTO_TEST_CASE(memoryModuleBacking) {
+    auto path = (std::filesystem::temp_directory_path() / "sysnp-ram.bin").string();
+    std::filesystem::remove(path);
+
+    {
+        MemoryModule module(0x1000, 8192, false, path, 0, 0, "Persistent");
+        BOOST_CHECK(module.read(0x1000) == 0);
+        module.write(0x1000, 0x55);
+        module.write(0x2fff, 0xaa);
+    }
+    BOOST_CHECK(std::filesystem::file_size(path) == 8192);
+    {
+        MemoryModule module(0x1000, 8192, false, path, 0, 0, "Persistent");
+        BOOST_CHECK(module.read(0x1000) == 0x55);
+        BOOST_CHECK(module.read(0x2fff) == 0xaa);
+    }
+    std::filesystem::remove(path);
+
+    // A ROM larger than its image reads zeros past the end of the file
+    MemoryModule rom(0, 0x20000, true, "bios.bin", 0, 0, "ROM");
+    BOOST_CHECK(rom.read(0x1ffff) == 0);
+    rom.write(0x1ffff, 0x55);
+    BOOST_CHECK(rom.read(0x1ffff) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(memoryModuleSnapshot) {
+    auto path = (std::filesystem::temp_directory_path() / "sysnp-module.snp").string();
+
+    MemoryModule module(0, 65536, false, "", 0, 0, "Snapshot");
+    module.write(0x0000, 0x11);
+    module.write(0x8001, 0x22);
+    module.write(0xffff, 0x33);
+    {
+        sysnp::SnapshotWriter snapshot(path);
+        module.saveState(snapshot);
+        snapshot.commit();
+    }
+
+    module.write(0x0000, 0x44);
+    module.write(0x4000, 0x55);
+    {
+        sysnp::SnapshotReader snapshot(path);
+        module.loadState(snapshot);
+    }
+    BOOST_CHECK(module.read(0x0000) == 0x11);
+    BOOST_CHECK(module.read(0x4000) == 0);
+    BOOST_CHECK(module.read(0x8001) == 0x22);
+    BOOST_CHECK(module.read(0xffff) == 0x33);
+
+    // Restored pages are private to the module
+    module.write(0x8001, 0x66);
+    MemoryModule other(0, 65536, false, "", 0, 0, "Other");
+    {
+        sysnp::SnapshotReader snapshot(path);
+        other.loadState(snapshot);
+    }
+    BOOST_CHECK(other.read(0x8001) == 0x22);
+    BOOST_CHECK(module.read(0x8001) == 0x66);
+
+    MemoryModule smaller(0, 4096, false, "", 0, 0, "Smaller");
+    {
+        sysnp::SnapshotReader snapshot(path);
+        BOOST_CHECK_THROW(smaller.loadState(snapshot), std::runtime_error);
+    }
+    std::filesystem::remove(path);
 }
 
 BOOST_AUTO_TEST_CASE(memory, * boost::unit_test::depends_on("NBus/nbus")) {
@@ -138,4 +225,117 @@ modules:\n\
     BOOST_CHECK(busInterface->senseSignal(NBusSignal::Data) == 0x55aa);
 }
 
+BOOST_AUTO_TEST_CASE(decoder) {
+    char config[] = "module: memory\n\
+ioHole: 0xf00000\n\
+ioHoleSize: 0x040000\n\
+modules:\n\
+  - {size: 6, name: \"low\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n\
+  - {size: 2, name: \"high\", start: 0x001800, rom: false, readLatency: 2, writeLatency: 3}";
+    auto tree = ryml::parse_in_place(config);
+    auto memoryConfig = tree.rootref();
+
+    auto machine = std::make_shared<sysnp::Machine>();
+    auto memory = std::make_shared<Memory>();
+    memory->setMachine(machine);
+    memory->init(memoryConfig);
+
+    // 0x1000-0x1fff is shared by both modules
+    NBusTransaction write;
+    write.address = 0x17fe;
+    write.writeEnable = 0b11;
+    write.words = 2;
+    write.data = {0x1234, 0x5678};
+    BOOST_CHECK(memory->transact(write) == 2);
+
+    NBusTransaction read;
+    read.address = 0x17fe;
+    read.words = 1;
+    BOOST_CHECK(memory->transact(read) == 1);
+    BOOST_CHECK(read.data[0] == 0x1234);
+
+    read.address = 0x1800;
+    BOOST_CHECK(memory->transact(read) == 3);
+    BOOST_CHECK(read.data[0] == 0x5678);
+
+    // a transaction crossing into the next module reads from both
+    read.address = 0x17fe;
+    read.words = 2;
+    BOOST_CHECK(memory->transact(read) == 2);
+    BOOST_CHECK(read.data[0] == 0x1234 && read.data[1] == 0x5678);
+    read.words = 1;
+
+    write.address = 0x1800;
+    write.words = 1;
+    BOOST_CHECK(memory->transact(write) == 4);
+    memory->transact(read);
+    BOOST_CHECK(read.data[0] == 0x1234);
+
+    read.address = 0x2000;
+    BOOST_CHECK(memory->transact(read) == 1);
+    BOOST_CHECK(read.data[0] == 0);
+
+    char overlapping[] = "module: memory\n\
+ioHole: 0xf00000\n\
+ioHoleSize: 0x040000\n\
+modules:\n\
+  - {size: 8, name: \"a\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n\
+  - {size: 8, name: \"b\", start: 0x001000, rom: false, readLatency: 0, writeLatency: 0}";
+    auto overlappingTree = ryml::parse_in_place(overlapping);
+    auto overlappingConfig = overlappingTree.rootref();
+
+    auto overlappingMemory = std::make_shared<Memory>();
+    overlappingMemory->setMachine(machine);
+    BOOST_CHECK_THROW(overlappingMemory->init(overlappingConfig), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(burst, * boost::unit_test::depends_on("NBus/nbus")) {
+    char config[] = "module: memory\n\
+ioHole: 0xf00000\n\
+ioHoleSize: 0x040000\n\
+modules:\n\
+  - {size: 6, name: \"low\", start: 0x000000, rom: false, readLatency: 0, writeLatency: 0}\n\
+  - {size: 2, name: \"high\", start: 0x001800, rom: false, readLatency: 0, writeLatency: 0}";
+    auto tree = ryml::parse_in_place(config);
+    auto memoryConfig = tree.rootref();
+
+    auto machine = std::make_shared<sysnp::Machine>();
+    auto memory = std::make_shared<Memory>();
+    memory->setMachine(machine);
+    memory->init(memoryConfig);
+
+    auto nbus = std::make_shared<NBus>();
+    nbus->setMachine(machine);
+
+    auto busInterface = std::make_shared<NBusInterface>(nbus, nbus);
+    auto memInterface = std::make_shared<NBusInterface>(nbus, memory);
+    nbus->addInterface(busInterface);
+    nbus->addInterface(memInterface);
+    nbus->postInit();
+
+    memory->setInterface(memInterface);
+    memory->postInit();
+
+    NBusTransaction write;
+    write.address = 0x17fe;
+    write.writeEnable = 0b11;
+    write.words = 2;
+    write.data = {0x1234, 0x5678};
+    memory->transact(write);
+
+    // a burst read running from one module into the next
+    busInterface->assertSignal(NBusSignal::ReadEnable, NBusReadBurst);
+    for (uint32_t address: {0x17fe, 0x17fe}) {
+        busInterface->assertSignal(NBusSignal::Address, address);
+        memory->clockDown();
+        memory->clockUp();
+    }
+    BOOST_CHECK(busInterface->senseSignal(NBusSignal::Data) == 0x1234);
+
+    busInterface->assertSignal(NBusSignal::Address, 0x1800);
+    memory->clockDown();
+    memory->clockUp();
+    BOOST_CHECK(busInterface->senseSignal(NBusSignal::Data) == 0x5678);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,7 +10,27 @@ BOOST_AUTO_TEST_CASE(nbus) {
 }
 
 BOOST_AUTO_TEST_CASE(nbusInterface) {
-    BOOST_CHECK(1);
+    auto nbus = std::make_shared<sysnp::nbus::NBus>();
+
+    auto a = std::make_shared<NBusInterface>(nbus, nbus);
+    auto b = std::make_shared<NBusInterface>(nbus, nbus);
+
+    BOOST_CHECK(a->senseSignal(NBusSignal::Address) == 0);
+
+    a->assertSignal(NBusSignal::Address, 0x000f00);
+    b->assertSignal(NBusSignal::Address, 0x0000f0);
+    BOOST_CHECK(a->senseSignal(NBusSignal::Address) == 0x000ff0);
+
+    a->deassertSignal(NBusSignal::Address);
+    BOOST_CHECK(b->senseSignal(NBusSignal::Address) == 0x0000f0);
+
+    // values are masked to the width of the signal
+    a->assertSignal(NBusSignal::ReadEnable, 0b111);
+    BOOST_CHECK(b->senseSignal(NBusSignal::ReadEnable) == 0b11);
+
+    // a departing interface stops driving the bus
+    b.reset();
+    BOOST_CHECK(a->senseSignal(NBusSignal::Address) == 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()